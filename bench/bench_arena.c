@@ -0,0 +1,88 @@
+#include "tilemap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ROOM_COUNT 200000
+#define ROOMS_PER_RESET 64
+#define RUNS 5
+
+// Returns the time since start, in milliseconds
+static double elapsed_ms(struct timespec start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+// Builds a room the way a dungeon generator might: give it its own tileset, wall it in, then grow and trim it.
+// Only the border is carved, so that the timings are dominated by the room's lifecycle rather than by tile writes.
+static tilemap build_room(uint16 w, uint16 h, tile_arena arena) {
+    tilemap room = arena ? tilemap_new_arena(w, h, arena) : tilemap_new(w, h);
+
+    tileset set = tileset_empty;
+    set.arena = arena;
+    tileset_resize(&set, 4, 4);
+    tileset_set_mask(&set, 1, 1);
+    tileset_set_property_float(&set, 0, "friction", 0.8f);
+    tilemap_set_tileset(room, set);
+
+    for(uint16 i = 0; i < w; ++i) {
+        tilemap_set_tile(room, i, 0, 1);
+        tilemap_set_tile(room, i, h - 1, 1);
+    }
+    for(uint16 i = 1; i < h - 1; ++i) {
+        tilemap_set_tile(room, 0, i, 1);
+        tilemap_set_tile(room, w - 1, i, 1);
+    }
+
+    tilemap_resize(room, w + 4, h - 2);
+    tilemap_resize(room, w - 6, h + 3);
+
+    return room;
+}
+
+int main(int argc, char** argv) {
+    // Both runs use the same sequence of room sizes
+    uint16* sizes = malloc(ROOM_COUNT * 2 * sizeof(uint16));
+    srand(1);
+    for(int i = 0; i < ROOM_COUNT * 2; ++i) {
+        sizes[i] = 8 + rand() % 40;
+    }
+
+    // Rooms are never drawn, so arena rooms are dropped in bulk by resetting the arena rather than freed one by one
+    tile_arena arena = tile_arena_new(1 << 20);
+
+    // Alternate between the two so that neither gets a warmer heap, and keep the best run of each
+    double heap_ms = 0;
+    double arena_ms = 0;
+    for(int run = 0; run < RUNS; ++run) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int i = 0; i < ROOM_COUNT; ++i) {
+            tilemap room = build_room(sizes[i * 2], sizes[i * 2 + 1], NULL);
+            tilemap_free(room, true);
+        }
+        double ms = elapsed_ms(start);
+        heap_ms = run == 0 || ms < heap_ms ? ms : heap_ms;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int i = 0; i < ROOM_COUNT; ++i) {
+            build_room(sizes[i * 2], sizes[i * 2 + 1], arena);
+            if((i + 1) % ROOMS_PER_RESET == 0) {
+                tile_arena_reset(arena);
+            }
+        }
+        tile_arena_reset(arena);
+        ms = elapsed_ms(start);
+        arena_ms = run == 0 || ms < arena_ms ? ms : arena_ms;
+    }
+
+    printf("heap rooms:  %8.2f ms, %6.2f us per room\n", heap_ms, heap_ms * 1000.0 / ROOM_COUNT);
+    printf("arena rooms: %8.2f ms, %6.2f us per room\n", arena_ms, arena_ms * 1000.0 / ROOM_COUNT);
+
+    tile_arena_free(arena);
+    free(sizes);
+
+    return 0;
+}
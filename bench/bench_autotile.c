@@ -0,0 +1,76 @@
+#include "tilemap.h"
+#include "tilemap_autotile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAP_DIM 4096
+#define BRUSH_RADIUS 3
+#define STROKE_STEPS 500
+
+// Returns the time since start, in milliseconds
+static double elapsed_ms(struct timespec start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+int main(int argc, char** argv) {
+    // A blob set: one tile per reduced mask for each of two terrains. The benchmark never draws, so no texture is needed.
+    tileset set = tileset_empty;
+    tileset_resize(&set, 16, 8);
+    uint8 grass = tileset_add_terrain(&set, "grass");
+    uint8 water = tileset_add_terrain(&set, "water");
+    uint16 count = 0;
+    for(uint16 mask = 0; mask < 256; ++mask) {
+        if(tile_autotiler_reduce_mask(mask) == mask) {
+            tileset_set_terrain_rule(&set, grass, mask, count);
+            tileset_set_terrain_rule(&set, water, mask, 64 + count);
+            ++count;
+        }
+    }
+
+    tilemap map = tilemap_new(MAP_DIM, MAP_DIM);
+    tilemap_set_tileset(map, set);
+    tile_autotiler autotiler = tile_autotiler_new(map);
+
+    // Random blocks of water on grass, so that there are plenty of edges to resolve
+    srand(1);
+    for(int i = 0; i < MAP_DIM; ++i) {
+        for(int j = 0; j < MAP_DIM; ++j) {
+            tile_autotiler_paint(autotiler, j, i, ((i / 8) * 31 + (j / 8) * 17 + rand() % 4) % 7 == 0 ? water : grass);
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32 changed = tile_autotiler_resolve_all(autotiler);
+    printf("resolve all:          %8.2f ms, %u tiles changed\n", elapsed_ms(start), changed);
+
+    // A brush stroke across the map, updating once per painted step as an editor would each frame
+    double total = 0;
+    double worst = 0;
+    for(int step = 0; step < STROKE_STEPS; ++step) {
+        int cx = 100 + step * 7;
+        int cy = 2000 + (step % 50) * 3;
+        for(int y = cy - BRUSH_RADIUS; y <= cy + BRUSH_RADIUS; ++y) {
+            for(int x = cx - BRUSH_RADIUS; x <= cx + BRUSH_RADIUS; ++x) {
+                tile_autotiler_paint(autotiler, x, y, water);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        tile_autotiler_update(autotiler, 0);
+        double ms = elapsed_ms(start);
+        total += ms;
+        worst = ms > worst ? ms : worst;
+    }
+    printf("brush update (avg):   %8.4f ms\n", total / STROKE_STEPS);
+    printf("brush update (worst): %8.4f ms\n", worst);
+
+    tile_autotiler_free(autotiler);
+    tilemap_free(map, true);
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "tilemap.h"
+#include "tilemap_region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAP_DIM 4096
+#define WALL_TILE 1
+#define FILL_TILE 2
+#define WALL_MASK 1
+
+// Returns the time since start, in milliseconds
+static double elapsed_ms(struct timespec start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+int main(int argc, char** argv) {
+    // The benchmark never draws, so a tileset without a texture is enough
+    tileset set = tileset_empty;
+    tileset_resize(&set, 4, 4);
+    tileset_set_mask(&set, WALL_TILE, WALL_MASK);
+
+    tilemap map = tilemap_new(MAP_DIM, MAP_DIM);
+    tilemap_set_tileset(map, set);
+
+    // Scatter walls over open floor, so that there's one huge region and lots of small ones
+    srand(1);
+    for(int i = 0; i < MAP_DIM; ++i) {
+        for(int j = 0; j < MAP_DIM; ++j) {
+            tilemap_set_tile(map, j, i, rand() % 5 == 0 ? WALL_TILE : 0);
+        }
+    }
+    tilemap_set_tile(map, 0, 0, 0);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32 filled = tilemap_flood_fill(map, 0, 0, FILL_TILE, TILE_MATCH_ID, 0);
+    printf("flood fill (id):      %8.2f ms, %u tiles\n", elapsed_ms(start), filled);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    filled = tilemap_flood_fill(map, 0, 0, 0, TILE_MATCH_MASK, WALL_MASK);
+    printf("flood fill (mask):    %8.2f ms, %u tiles\n", elapsed_ms(start), filled);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    tile_labels labels = tilemap_label_regions(map, TILE_MATCH_ID, 0);
+    printf("label regions (id):   %8.2f ms, %u regions\n", elapsed_ms(start), labels.region_count);
+    tile_labels_cleanup(&labels);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    labels = tilemap_label_regions(map, TILE_MATCH_MASK, WALL_MASK);
+    printf("label regions (mask): %8.2f ms, %u regions\n", elapsed_ms(start), labels.region_count);
+    tile_labels_cleanup(&labels);
+
+    tilemap_free(map, true);
+
+    return 0;
+}
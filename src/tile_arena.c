@@ -0,0 +1,113 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tile_arena.h"
+
+#include "core/check.h"
+
+#include <stdalign.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+
+    alignas(ARENA_ALIGNMENT) ubyte data[];
+} arena_block;
+
+typedef struct tile_arena {
+    size_t block_size;
+
+    // Blocks are kept across resets, with allocations taken from current onwards
+    arena_block* first;
+    arena_block* current;
+    size_t used;
+}* tile_arena;
+
+static arena_block* arena_block_new(size_t size) {
+    arena_block* block = salloc(sizeof(arena_block) + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+// Creates an empty arena that takes memory from the heap block_size bytes at a time
+tile_arena tile_arena_new(size_t block_size) {
+    check_return(block_size > 0, "Can't create an arena with empty blocks", NULL);
+
+    tile_arena arena = mscalloc(1, struct tile_arena);
+    arena->block_size = block_size;
+    arena->first = arena_block_new(block_size);
+    arena->current = arena->first;
+
+    return arena;
+}
+
+// Frees an arena and everything allocated from it
+void _tile_arena_free(tile_arena arena) {
+    arena_block* block = arena->first;
+    while(block) {
+        arena_block* next = block->next;
+        sfree(block);
+        block = next;
+    }
+
+    sfree(arena);
+}
+
+// Returns size bytes of zeroed memory from the arena, aligned for any type. Returns NULL if an error occurs.
+void* tile_arena_alloc(tile_arena arena, size_t size) {
+    check_return(arena, "Can't allocate from a NULL arena", NULL);
+
+    size_t aligned = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if(aligned == 0) {
+        aligned = ARENA_ALIGNMENT;
+    }
+
+    // Move on to the next block that fits, adding a new one once the existing blocks run out
+    arena_block* block = arena->current;
+    while(block->size - block->used < aligned) {
+        if(!block->next) {
+            block->next = arena_block_new(aligned > arena->block_size ? aligned : arena->block_size);
+        }
+        block = block->next;
+    }
+    arena->current = block;
+
+    void* result = block->data + block->used;
+    block->used += aligned;
+    arena->used += aligned;
+    memset(result, 0, size);
+
+    return result;
+}
+
+// Copies str into the arena
+char* tile_arena_strdup(tile_arena arena, const char* str) {
+    check_return(str, "Can't copy a NULL string into an arena", NULL);
+
+    size_t length = strlen(str) + 1;
+    char* result = tile_arena_alloc(arena, length);
+    memcpy(result, str, length);
+
+    return result;
+}
+
+// Releases everything allocated from the arena, keeping its memory for reuse
+void tile_arena_reset(tile_arena arena) {
+    for(arena_block* block = arena->first; block; block = block->next) {
+        block->used = 0;
+    }
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+// Returns the number of bytes allocated from the arena since it was last reset
+size_t tile_arena_get_used(tile_arena arena) {
+    return arena->used;
+}
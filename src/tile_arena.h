@@ -0,0 +1,30 @@
+#ifndef DF_TILES_TILE_ARENA
+#define DF_TILES_TILE_ARENA
+#include "core/types.h"
+
+#include <stddef.h>
+
+// A bump allocator for tilemaps and tilesets that are created and thrown away in bulk, such as procedurally generated rooms.
+// Everything allocated from an arena is released at once by resetting it, and its memory is reused afterwards.
+declarep(struct, tile_arena)
+
+// Creates an empty arena that takes memory from the heap block_size bytes at a time
+tile_arena tile_arena_new(size_t block_size);
+
+// Frees an arena and everything allocated from it
+#define tile_arena_free(arena) { _tile_arena_free(arena); arena = NULL; }
+void _tile_arena_free(tile_arena arena);
+
+// Returns size bytes of zeroed memory from the arena, aligned for any type. Returns NULL if an error occurs.
+void* tile_arena_alloc(tile_arena arena, size_t size);
+
+// Copies str into the arena
+char* tile_arena_strdup(tile_arena arena, const char* str);
+
+// Releases everything allocated from the arena, keeping its memory for reuse
+void tile_arena_reset(tile_arena arena);
+
+// Returns the number of bytes allocated from the arena since it was last reset
+size_t tile_arena_get_used(tile_arena arena);
+
+#endif
@@ -2,12 +2,15 @@
 #define LOG_CATEGORY "Tiles"
 
 #include "tilemap.h"
+#include "tilemap_delta.h"
 
 #include "shader_tilemap.h"
 
 #include "core/check.h"
 #include "math/matrix.h"
 
+#include <string.h>
+
 #include "tilemap.priv.h"
 
 static shader shader_tilemap = {0};
@@ -18,8 +21,8 @@ void tilemap_update_tiles(tilemap map) {
 
     check_return(map->width * map->height != 0, "Tilemap is invalid", );
 
-    aabb_2d tiles[map->width * map->height];
-    uint16 index = 0;
+    aabb_2d* tiles = mscalloc(map->width * map->height, aabb_2d);
+    uint32 index = 0;
     for(int i = 0; i < map->height; ++i) {
         for(int j = 0; j < map->width; ++j) {
             if(map->tile_data[i * map->width + j].id != NO_TILE) {
@@ -29,8 +32,13 @@ void tilemap_update_tiles(tilemap map) {
         }
     }
 
+    // The buffer is created on first upload, so that maps which are never drawn don't need a GL context
+    if(map->tile_handle == 0) {
+        glGenBuffers(1, &map->tile_handle);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, map->tile_handle);
     glBufferData(GL_ARRAY_BUFFER, index * sizeof(aabb_2d), tiles, GL_DYNAMIC_DRAW);
+    sfree(tiles);
 }
 
 // Rebuilds the mesh data for map
@@ -40,8 +48,8 @@ void tilemap_rebuild_mesh(tilemap map) {
     if(map->m)
         mesh_free(map->m);
 
-    vt_p mesh_data[map->width * map->height];
-    uint16 index = 0;
+    vt_p* mesh_data = mscalloc(map->width * map->height, vt_p);
+    uint32 index = 0;
     for(int i = 0; i < map->height; ++i) {
         for(int j = 0; j < map->width; ++j) {
             if(map->tile_data[i * map->width + j].id != NO_TILE) {
@@ -58,45 +66,70 @@ void tilemap_rebuild_mesh(tilemap map) {
         map->m = mesh_new(index, mesh_data, NULL);
         tilemap_update_tiles(map);
     }
+    sfree(mesh_data);
 }
 
-// Creates a new empty tilemap
-tilemap tilemap_new(uint16 w, uint16 h) {
+static tilemap tilemap_create(uint16 w, uint16 h, tile_arena arena) {
     check_return(w * h != 0, "Trying to create a tilemap with the invalid dimensions [%dx%d]", NULL, w, h);
 
-    tilemap map = mscalloc(1, struct tilemap);
+    tilemap map = arena ? tile_arena_alloc(arena, sizeof(struct tilemap)) : mscalloc(1, struct tilemap);
 
+    map->arena = arena;
     map->width = w;
     map->height = h;
-    map->tile_data = mscalloc(w * h, tile);
-    for(uint16 i = 0; i < w * h; ++i) {
+    map->tile_capacity = (uint32)w * h;
+    map->tile_data = arena ? tile_arena_alloc(arena, map->tile_capacity * sizeof(tile)) : mscalloc(map->tile_capacity, tile);
+    for(uint32 i = 0; i < map->tile_capacity; ++i) {
         map->tile_data[i] = (tile){ .id=NO_TILE, .mask=0 };
     }
     map->asset_path = NULL;
     map->is_empty = true;
     map->tiles_dirty = false;
     map->mesh_dirty = false;
-
-    glGenBuffers(1, &map->tile_handle);
+    map->lod = NULL;
 
     return map;
 }
 
+// Creates a new empty tilemap
+tilemap tilemap_new(uint16 w, uint16 h) {
+    return tilemap_create(w, h, NULL);
+}
+
+// Creates a new empty tilemap, allocating it and its tiles from arena. The map must not be used after the arena is reset.
+// Maps that were never drawn, snapshotted or given a journal have no other resources, so they can be dropped by resetting the arena instead of being freed.
+tilemap tilemap_new_arena(uint16 w, uint16 h, tile_arena arena) {
+    check_return(arena, "Trying to create a tilemap from a NULL arena", NULL);
+
+    return tilemap_create(w, h, arena);
+}
+
 // Frees an existing tilemap. If deep is true, frees any associated tileset information.
 void _tilemap_free(tilemap map, bool deep) {
-    sfree(map->tile_data);
+    tilemap_snapshot_detach_all(map);
+    if(!map->arena) {
+        sfree(map->tile_data);
+    }
 
     if(deep) {
         tileset_cleanup(&map->set);
     }
 
-    glDeleteBuffers(1, &map->tile_handle);
+    if(map->tile_handle) {
+        glDeleteBuffers(1, &map->tile_handle);
+    }
+    tilemap_lod_free(map);
+    tilemap_journal_disable(map);
 
-    mesh_free(map->m);
+    if(map->m) {
+        mesh_free(map->m);
+    }
     if(map->asset_path) {
         sfree(map->asset_path);
     }
-    sfree(map);
+    if(!map->arena) {
+        sfree(map);
+    }
 }
 
 // Sets the tilemap's tileset
@@ -105,7 +138,8 @@ void tilemap_set_tileset(tilemap map, tileset set) {
     check_warn(map->set.width * map->set.height <= set.width * set.height, "Setting a tileset with smaller dimensions than before, some tiles may be invalid");
 
     map->set = set;
-    tilemap_update_tiles(map);
+    map->tiles_dirty = true;
+    tilemap_lod_invalidate(map);
 }
 
 // Sets the tile at [x, y]
@@ -116,6 +150,7 @@ void tilemap_set_tile(tilemap map, uint16 x, uint16 y, uint16 id) {
     // Set dirty flags
     if(map->tile_data[y * map->width + x].id != id) {
         map->tiles_dirty = true;
+        tilemap_lod_mark(map, x, y);
 
         // If we're removing a tile or placing one where it didn't exist before, the mesh will need rebuilding
         if((map->tile_data[y * map->width + x].id == NO_TILE || id == NO_TILE)) {
@@ -123,16 +158,88 @@ void tilemap_set_tile(tilemap map, uint16 x, uint16 y, uint16 id) {
         }
     }
 
-    map->tile_data[y * map->width + x] = (tile){ .id = id, .mask = tileset_get_mask(map->set, id) };
+    tile value = (tile){ .id = id, .mask = tileset_get_mask(map->set, id) };
+    if(map->tile_data[y * map->width + x].id != value.id || map->tile_data[y * map->width + x].mask != value.mask) {
+        tilemap_journal_record(map, y * map->width + x);
+    }
+
+    tilemap_snapshot_preserve(map, y * map->width + x, 1);
+    map->tile_data[y * map->width + x] = value;
 }
 
 // Sets the tile mask at [x, y]
 void tilemap_set_tile_mask(tilemap map, uint16 x, uint16 y, uint8 mask) {
     check_return(x < map->width && y < map->height, "Can't set out-of-bounds tile at [%d, %d] from a %dx%d map", , x, y, map->width, map->height);
 
+    if(map->tile_data[y * map->width + x].mask != mask) {
+        tilemap_journal_record(map, y * map->width + x);
+    }
+
+    tilemap_snapshot_preserve(map, y * map->width + x, 1);
     map->tile_data[y * map->width + x].mask = mask;
 }
 
+// Writes value to the tile at index without any checks, updating dirty flags and the journal as tilemap_set_tile would.
+// Callers must have preserved the tile's page with tilemap_snapshot_preserve first.
+void tilemap_write_tile(tilemap map, uint32 index, tile value) {
+    tile* current = &map->tile_data[index];
+    if(current->id == value.id && current->mask == value.mask) {
+        return;
+    }
+
+    if(current->id != value.id) {
+        map->tiles_dirty = true;
+        tilemap_lod_mark(map, index % map->width, index / map->width);
+
+        // If we're removing a tile or placing one where it didn't exist before, the mesh will need rebuilding
+        if(current->id == NO_TILE || value.id == NO_TILE) {
+            map->mesh_dirty = true;
+        }
+    }
+
+    tilemap_journal_record(map, index);
+    *current = value;
+}
+
+// Writes value to count consecutive tiles from index, updating dirty flags, the LOD cache and the journal once for the whole span.
+// Callers must have preserved the span's pages with tilemap_snapshot_preserve first.
+void tilemap_write_span(tilemap map, uint32 index, uint32 count, tile value) {
+    uint32 first = UINT32_MAX;
+    uint32 last = 0;
+    bool ids_changed = false;
+    bool presence_changed = false;
+    for(uint32 i = index; i < index + count; ++i) {
+        tile* current = &map->tile_data[i];
+        if(current->id == value.id && current->mask == value.mask) {
+            continue;
+        }
+
+        if(current->id != value.id) {
+            ids_changed = true;
+            presence_changed |= current->id == NO_TILE || value.id == NO_TILE;
+        }
+        if(first == UINT32_MAX) {
+            first = i;
+        }
+        last = i;
+        *current = value;
+    }
+
+    if(first == UINT32_MAX) {
+        return;
+    }
+
+    // Unchanged tiles between the first and last changed ones are recorded too, which is harmless and keeps this to one call
+    if(ids_changed) {
+        map->tiles_dirty = true;
+        tilemap_lod_mark_span(map, first, last - first + 1);
+    }
+    if(presence_changed) {
+        map->mesh_dirty = true;
+    }
+    tilemap_journal_record_span(map, first, last - first + 1);
+}
+
 // Returns the tile value at [x, y]. Defaults to 0 and logs a warning if [x,y] is out-of-bounds.
 tile tilemap_get_tile(tilemap map, uint16 x, uint16 y) {
     check_return(x < map->width && y < map->height, "Can't get out-of-bounds tile at [%d, %d] from a %dx%d map", (tile){0}, x, y, map->width, map->height);
@@ -166,25 +273,53 @@ uint16 tilemap_get_height(tilemap map) {
     return map->height;
 }
 
-// Resizes map, leaving the previous contents in the top-left corner
+// Resizes map, leaving the previous contents in the top-left corner. This happens in place if the map has room for the new size.
 void tilemap_resize(tilemap map, uint16 w, uint16 h) {
     check_return(w * h != 0, "Trying to resize a map to invalid dimensions [%dx%d]", , w, h);
-    tile* new_data = mscalloc(w * h, tile);
-
-    // Copy the data from the old array to the new one. Note that
-    // bounds-checking must be performed on *both* buffers, since either one
-    // could be smaller.
-    for(int i = 0; i < map->height && i < h; ++i) {
-        for(int j = 0; j < map->width && j < w; ++j) {
-            new_data[i * w + j] = map->tile_data[i * map->width + j];
+
+    // Rows are about to move, so snapshots need their own copies of them first
+    tilemap_snapshot_detach_all(map);
+
+    uint32 old_width = map->width;
+    uint32 old_height = map->height;
+    uint32 area = (uint32)w * h;
+    if(area > map->tile_capacity) {
+        if(map->arena) {
+            // The old tiles stay in the arena until it's reset
+            tile* new_data = tile_arena_alloc(map->arena, area * sizeof(tile));
+            memcpy(new_data, map->tile_data, old_width * old_height * sizeof(tile));
+            map->tile_data = new_data;
+        } else {
+            map->tile_data = srealloc(map->tile_data, area * sizeof(tile));
         }
+        map->tile_capacity = area;
+    }
+
+    // Rows move towards the start when narrowing and towards the end when widening,
+    // so walk them in the order that never overwrites a row before it's been moved.
+    tile* data = map->tile_data;
+    uint32 copy_height = h < old_height ? h : old_height;
+    if(w < old_width) {
+        for(uint32 i = 1; i < copy_height; ++i) {
+            memmove(data + i * w, data + i * old_width, w * sizeof(tile));
+        }
+    } else if(w > old_width) {
+        for(uint32 i = copy_height; i-- > 0;) {
+            memmove(data + i * w, data + i * old_width, old_width * sizeof(tile));
+            memset(data + i * w + old_width, 0, (w - old_width) * sizeof(tile));
+        }
+    }
+    if(h > old_height) {
+        memset(data + old_height * w, 0, (h - old_height) * w * sizeof(tile));
     }
 
-    sfree(map->tile_data);
-    map->tile_data = new_data;
     map->width = w;
     map->height = h;
-    tilemap_rebuild_mesh(map);
+
+    // The mesh is rebuilt on the next draw, so that resizing doesn't need a GL context
+    map->mesh_dirty = true;
+    tilemap_lod_invalidate(map);
+    tilemap_journal_reset(map);
 }
 
 // Returns the default shader for rendering tilemaps. This will compile the shader if it hasn't been done already.
@@ -205,7 +340,7 @@ void tilemap_draw(tilemap map, shader s, mat4 model, mat4 view) {
         tilemap_update_tiles(map);
     }
 
-    if(map->is_empty) {
+    if(map->is_empty || tilemap_lod_draw(map, s, model, view)) {
         return;
     }
 
@@ -7,6 +7,7 @@
 #include "tileset.h"
 
 declarep(struct, tilemap)
+declarep(struct, tilemap_snapshot)
 typedef struct tile {
     uint16 id;
     uint8 mask;
@@ -15,6 +16,10 @@ typedef struct tile {
 // Creates a new empty tilemap
 tilemap tilemap_new(uint16 w, uint16 h);
 
+// Creates a new empty tilemap, allocating it and its tiles from arena. The map must not be used after the arena is reset.
+// Maps that were never drawn, snapshotted or given a journal have no other resources, so they can be dropped by resetting the arena instead of being freed.
+tilemap tilemap_new_arena(uint16 w, uint16 h, tile_arena arena);
+
 // Frees an existing tilemap. If deep is true, frees any associated tileset information.
 #define tilemap_free(map, deep) { _tilemap_free(map, deep); map = NULL; }
 void _tilemap_free(tilemap map, bool deep);
@@ -46,13 +51,43 @@ uint16 tilemap_get_width(tilemap map);
 // Returns the height of map
 uint16 tilemap_get_height(tilemap map);
 
-// Resizes map, leaving the previous contents in the top-left corner
+// Resizes map, leaving the previous contents in the top-left corner. This happens in place if the map has room for the new size.
 void tilemap_resize(tilemap map, uint16 w, uint16 h);
 
+// Takes an immutable snapshot of map's tiles. Pages are shared with map until it modifies them, so this doesn't copy the grid.
+// The snapshot can be read and freed from any thread, while map keeps being edited on its own thread.
+tilemap_snapshot tilemap_snapshot_new(tilemap map);
+
+// Frees a snapshot. This is safe to call from any thread.
+#define tilemap_snapshot_free(snapshot) { _tilemap_snapshot_free(snapshot); snapshot = NULL; }
+void _tilemap_snapshot_free(tilemap_snapshot snapshot);
+
+// Copies count tiles, starting at row-major index start, out of the snapshot
+void tilemap_snapshot_read(tilemap_snapshot snapshot, uint32 start, uint32 count, tile* out);
+
+// Returns the tile value at [x, y] when the snapshot was taken. Defaults to 0 and logs a warning if [x,y] is out-of-bounds.
+tile tilemap_snapshot_get_tile(tilemap_snapshot snapshot, uint16 x, uint16 y);
+
+// Returns the width of the snapshot
+uint16 tilemap_snapshot_get_width(tilemap_snapshot snapshot);
+
+// Returns the height of the snapshot
+uint16 tilemap_snapshot_get_height(tilemap_snapshot snapshot);
+
+// Returns the asset path of the map's tileset when the snapshot was taken, or NULL if it had none
+const char* tilemap_snapshot_get_tileset_path(tilemap_snapshot snapshot);
+
 // Returns the default shader for rendering tilemaps. This will compile the shader if it hasn't been done already.
 shader get_tilemap_shader();
 
 // Draws the tilemap with the given shader and transformation matrices
 void tilemap_draw(tilemap map, shader s, mat4 model, mat4 view);
 
+// Enables level-of-detail drawing. Once a tile covers fewer than threshold pixels on screen, tilemap_draw renders a cached texture baked at scale pixels per tile instead.
+// The cache is split into chunks of chunk_size tiles, which are only re-baked when their tiles change. Set threshold to 0 to disable.
+void tilemap_set_lod(tilemap map, float threshold, uint16 chunk_size, float scale);
+
+// Renders the whole map into a new width x height texture. This uses the level-of-detail cache when it's enabled. The caller is responsible for cleaning up the texture.
+gltex tilemap_bake_minimap(tilemap map, uint16 width, uint16 height);
+
 #endif
@@ -1,6 +1,47 @@
 #ifndef DF_TILES_TILEMAP_PRIV
 #define DF_TILES_TILEMAP_PRIV
 
+#include <pthread.h>
+
+// Number of tiles in each copy-on-write page of a snapshot
+#define TILEMAP_PAGE_TILES 4096
+
+// Cached low-resolution rendering of a tilemap, used when zoomed far out
+typedef struct tilemap_lod {
+    // On-screen pixels per tile below which the cached texture is drawn instead of tiles
+    float threshold;
+
+    // Baked pixels per tile
+    float scale;
+
+    uint16 chunk_size;
+    uint16 chunks_x;
+    uint16 chunks_y;
+    bool* chunk_dirty;
+    bool any_dirty;
+
+    gltex tex;
+    GLuint framebuffer;
+    GLuint buffers[2];
+} tilemap_lod;
+
+typedef struct tilemap_snapshot {
+    // Guards pages, map and released against the thread that owns the map
+    pthread_mutex_t lock;
+
+    // The map that unpreserved pages are read from, or NULL once every page has been copied
+    struct tilemap* map;
+    bool released;
+
+    uint16 width;
+    uint16 height;
+    char* tileset_path;
+
+    // Private copies of pages that the map has modified since the snapshot was taken
+    uint32 page_count;
+    tile** pages;
+}* tilemap_snapshot;
+
 typedef struct tilemap {
     mesh m;
     GLuint tile_handle;
@@ -11,11 +52,75 @@ typedef struct tilemap {
     tileset set;
     tile* tile_data;
 
+    // Number of tiles that tile_data has room for, so that resizing can happen in place
+    uint32 tile_capacity;
+
+    // The arena that the map and its tiles were allocated from, or NULL if they're on the heap
+    tile_arena arena;
+
     bool is_empty;
     bool tiles_dirty;
     bool mesh_dirty;
 
+    tilemap_lod* lod;
+
+    tilemap_snapshot* snapshots;
+    uint8 snapshot_count;
+
+    // Set for each page that some snapshot hasn't made a private copy of yet
+    bool* page_shared;
+
+    // Ring buffer of the indices of modified tiles, used to build deltas
+    uint32* journal;
+    uint32 journal_capacity;
+
+    // Number of changes made to the map so far, and the oldest version the journal can describe
+    uint32 version;
+    uint32 journal_base;
+
     char* asset_path;
 }* tilemap;
 
+// Writes value to the tile at index without any checks, updating dirty flags and the journal as tilemap_set_tile would.
+// Callers must have preserved the tile's page with tilemap_snapshot_preserve first.
+void tilemap_write_tile(tilemap map, uint32 index, tile value);
+
+// Writes value to count consecutive tiles from index, updating dirty flags, the LOD cache and the journal once for the whole span.
+// Callers must have preserved the span's pages with tilemap_snapshot_preserve first.
+void tilemap_write_span(tilemap map, uint32 index, uint32 count, tile value);
+
+// Gives every snapshot of map its own copy of the pages covering count tiles from start. Must be called before modifying tile_data.
+void tilemap_snapshot_preserve(tilemap map, uint32 start, uint32 count);
+
+// Copies all shared pages into map's snapshots and disconnects them, so that tile_data can be reallocated or freed
+void tilemap_snapshot_detach_all(tilemap map);
+
+// Bumps map's version, and records the change to tile index in its journal if it has one
+void tilemap_journal_record(tilemap map, uint32 index);
+
+// Bumps map's version once for each of count consecutive tiles from index, and records them in its journal if it has one
+void tilemap_journal_record_span(tilemap map, uint32 index, uint32 count);
+
+// Forgets every recorded change, for when the map's layout changes
+void tilemap_journal_reset(tilemap map);
+
+// Collects the sorted, unique indices of tiles changed since version into indices, and returns how many there are.
+// Returns UINT32_MAX if the journal no longer covers that version. The caller must free indices.
+uint32 tilemap_journal_collect(tilemap map, uint32 version, uint32** indices);
+
+// Marks the cached chunk containing [x, y] as needing a re-bake
+void tilemap_lod_mark(tilemap map, uint16 x, uint16 y);
+
+// Marks the cached chunks covering count consecutive tiles from index as needing a re-bake
+void tilemap_lod_mark_span(tilemap map, uint32 index, uint32 count);
+
+// Drops all cached chunks, so that they're re-created on the next draw
+void tilemap_lod_invalidate(tilemap map);
+
+// Draws the cached texture if map is zoomed out past its threshold. Returns false if the tiles should be drawn instead.
+bool tilemap_lod_draw(tilemap map, shader s, mat4 model, mat4 view);
+
+// Frees the level-of-detail data of map, if any
+void tilemap_lod_free(tilemap map);
+
 #endif
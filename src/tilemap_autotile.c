@@ -0,0 +1,405 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tilemap_autotile.h"
+
+#include "core/check.h"
+
+#include <string.h>
+
+#include "tilemap_delta.h"
+#include "tilemap.priv.h"
+
+// Journal capacity used when the autotiler has to enable the map's journal itself
+#define AUTOTILE_JOURNAL_CAPACITY 4096
+
+#define AUTOTILE_EDGES (AUTOTILE_N | AUTOTILE_E | AUTOTILE_S | AUTOTILE_W)
+
+// Marks cells outside the map when resolving a range of cells. These match every terrain.
+#define TERRAIN_EDGE (NO_TERRAIN - 1)
+
+// Evaluates to 1 if the neighbouring terrain n connects to terrain t
+#define TERRAIN_MATCH(n, t) (((n) == (t)) | ((n) == TERRAIN_EDGE))
+
+// Neighbour offsets, in mask bit order
+static const int8 neighbour_offsets[8][2] = {
+    {  0, -1 }, {  1, -1 }, {  1,  0 }, {  1,  1 },
+    {  0,  1 }, { -1,  1 }, { -1,  0 }, { -1, -1 },
+};
+
+typedef struct tile_autotiler {
+    tilemap map;
+    uint16 width;
+    uint16 height;
+
+    // Tile to draw for every neighbour mask, for each terrain
+    uint16 (*luts)[256];
+
+    // Tile to place when painting each terrain
+    uint16* paint_tiles;
+    uint8 terrain_count;
+
+    // Terrain of each tile id in the tileset, or NO_TERRAIN
+    uint8* tile_terrain;
+    uint32 tile_count;
+
+    uint32 version;
+
+    // FIFO of cells waiting to be resolved, with a bit per cell so that none are queued twice
+    uint32* queue;
+    uint32 queue_start;
+    uint32 queue_length;
+    uint32 queue_capacity;
+    uint64* queued;
+
+    // Cells from sweep_next up to sweep_end still need resolving, after changes that the journal couldn't describe
+    uint32 sweep_next;
+    uint32 sweep_end;
+}* tile_autotiler;
+
+static inline uint8 autotile_cell_terrain(const struct tile_autotiler* autotiler, uint32 index) {
+    uint16 id = autotiler->map->tile_data[index].id;
+    return id < autotiler->tile_count ? autotiler->tile_terrain[id] : NO_TERRAIN;
+}
+
+static void autotile_write(tile_autotiler autotiler, uint32 index, uint16 id) {
+    tilemap map = autotiler->map;
+    tilemap_snapshot_preserve(map, index, 1);
+    tilemap_write_tile(map, index, (tile){ .id = id, .mask = tileset_get_mask(map->set, id) });
+}
+
+// Builds each terrain's lookup table, so that resolving a cell is a single read
+static void autotile_build_tables(tile_autotiler autotiler, tileset set) {
+    autotiler->terrain_count = set.terrain_count;
+    autotiler->tile_count = set.width * set.height;
+    autotiler->tile_terrain = mscalloc(autotiler->tile_count > 0 ? autotiler->tile_count : 1, uint8);
+    memset(autotiler->tile_terrain, NO_TERRAIN, autotiler->tile_count);
+    if(set.terrain_count == 0) {
+        return;
+    }
+
+    autotiler->luts = scalloc(set.terrain_count, sizeof(*autotiler->luts));
+    autotiler->paint_tiles = mscalloc(set.terrain_count, uint16);
+    for(uint8 i = 0; i < set.terrain_count; ++i) {
+        const tile_terrain* terrain = &set.terrains[i];
+
+        // Rules may be written with corner bits that can never matter, so file them under their reduced mask
+        uint16 reduced[256];
+        autotiler->paint_tiles[i] = NO_TILE;
+        for(uint16 j = 0; j < 256; ++j) {
+            reduced[j] = NO_TILE;
+        }
+        for(uint16 j = 0; j < 256; ++j) {
+            uint16 id = terrain->rules[j];
+            if(id == NO_TILE || id >= autotiler->tile_count) {
+                continue;
+            }
+
+            uint8 mask = tile_autotiler_reduce_mask(j);
+            if(reduced[mask] == NO_TILE) {
+                reduced[mask] = id;
+            }
+            if(autotiler->paint_tiles[i] == NO_TILE) {
+                autotiler->paint_tiles[i] = id;
+            }
+
+            if(autotiler->tile_terrain[id] == NO_TERRAIN) {
+                autotiler->tile_terrain[id] = i;
+            } else if(autotiler->tile_terrain[id] != i) {
+                warn("Tile %d is used by terrains %s and %s, treating it as %s", id, set.terrains[autotiler->tile_terrain[id]].name, terrain->name, set.terrains[autotiler->tile_terrain[id]].name);
+            }
+        }
+
+        // Simpler sets only have rules for the edges, so fall back to those when there's no exact match
+        for(uint16 j = 0; j < 256; ++j) {
+            uint8 mask = tile_autotiler_reduce_mask(j);
+            autotiler->luts[i][j] = reduced[mask] != NO_TILE ? reduced[mask] : reduced[mask & AUTOTILE_EDGES];
+        }
+        if(reduced[0xFF] != NO_TILE) {
+            autotiler->paint_tiles[i] = reduced[0xFF];
+        }
+    }
+}
+
+// Matches the autotiler's per-cell data to the map's current size, dropping any queued cells and sweep
+static void autotile_sync_size(tile_autotiler autotiler) {
+    tilemap map = autotiler->map;
+    autotiler->width = map->width;
+    autotiler->height = map->height;
+    autotiler->queue_start = 0;
+    autotiler->queue_length = 0;
+    autotiler->sweep_next = 0;
+    autotiler->sweep_end = 0;
+
+    if(autotiler->queued) {
+        sfree(autotiler->queued);
+    }
+    autotiler->queued = mscalloc((map->width * map->height + 63) / 64, uint64);
+}
+
+static void autotile_queue(tile_autotiler autotiler, uint32 index) {
+    uint64 bit = (uint64)1 << (index & 63);
+    if(autotiler->queued[index >> 6] & bit) {
+        return;
+    }
+    autotiler->queued[index >> 6] |= bit;
+
+    if(autotiler->queue_length == autotiler->queue_capacity) {
+        // Reclaim the space of already-resolved cells before growing
+        if(autotiler->queue_start > 0) {
+            autotiler->queue_length -= autotiler->queue_start;
+            memmove(autotiler->queue, autotiler->queue + autotiler->queue_start, autotiler->queue_length * sizeof(uint32));
+            autotiler->queue_start = 0;
+        }
+        if(autotiler->queue_length == autotiler->queue_capacity) {
+            autotiler->queue_capacity = autotiler->queue_capacity ? autotiler->queue_capacity * 2 : 256;
+            autotiler->queue = srealloc(autotiler->queue, autotiler->queue_capacity * sizeof(uint32));
+        }
+    }
+
+    autotiler->queue[autotiler->queue_length++] = index;
+}
+
+// Picks the tile for a single cell from its neighbours. Returns true if the tile changed.
+static bool autotile_resolve_cell(tile_autotiler autotiler, uint32 index) {
+    uint8 terrain = autotile_cell_terrain(autotiler, index);
+    if(terrain == NO_TERRAIN) {
+        return false;
+    }
+
+    int32 x = index % autotiler->width;
+    int32 y = index / autotiler->width;
+    uint8 mask = 0;
+    for(uint8 i = 0; i < 8; ++i) {
+        int32 nx = x + neighbour_offsets[i][0];
+        int32 ny = y + neighbour_offsets[i][1];
+        if(nx < 0 || ny < 0 || nx >= autotiler->width || ny >= autotiler->height || autotile_cell_terrain(autotiler, ny * autotiler->width + nx) == terrain) {
+            mask |= 1 << i;
+        }
+    }
+
+    uint16 id = autotiler->luts[terrain][mask];
+    if(id == NO_TILE || id == autotiler->map->tile_data[index].id) {
+        return false;
+    }
+
+    autotile_write(autotiler, index, id);
+    return true;
+}
+
+// Computes the neighbour mask of each cell in a row of the padded terrain grid. Each row pointer starts at the row's left border cell.
+// This is branch-free over contiguous bytes, so that compilers can vectorise it.
+static void autotile_row_masks(const uint8* restrict up, const uint8* restrict mid, const uint8* restrict down, uint8* restrict masks, uint32 width) {
+    for(uint32 j = 0; j < width; ++j) {
+        uint8 t = mid[j + 1];
+        masks[j] = TERRAIN_MATCH(up[j + 1], t)
+                 | TERRAIN_MATCH(up[j + 2], t) << 1
+                 | TERRAIN_MATCH(mid[j + 2], t) << 2
+                 | TERRAIN_MATCH(down[j + 2], t) << 3
+                 | TERRAIN_MATCH(down[j + 1], t) << 4
+                 | TERRAIN_MATCH(down[j], t) << 5
+                 | TERRAIN_MATCH(mid[j], t) << 6
+                 | TERRAIN_MATCH(up[j], t) << 7;
+    }
+}
+
+// Resolves count cells from row-major index start, returning the number of tiles that changed.
+// The rows involved are classified up front, with a border of edge cells, so that they can be scanned without bounds checks.
+static uint32 autotile_resolve_range(tile_autotiler autotiler, uint32 start, uint32 count) {
+    tilemap map = autotiler->map;
+    if(count == 0 || autotiler->terrain_count == 0) {
+        return 0;
+    }
+
+    uint32 width = map->width;
+    uint32 height = map->height;
+    uint32 padded_width = width + 2;
+    uint32 first_row = start / width;
+    uint32 last_row = (start + count - 1) / width;
+    uint32 rows = last_row - first_row + 1;
+
+    // Row r of the padded grid holds map row first_row + r - 1
+    uint8* terrain = mscalloc(padded_width * (rows + 2), uint8);
+    memset(terrain, TERRAIN_EDGE, padded_width * (rows + 2));
+    for(uint32 r = 0; r < rows + 2; ++r) {
+        int64 i = (int64)first_row + r - 1;
+        if(i < 0 || i >= height) {
+            continue;
+        }
+
+        uint8* row = terrain + r * padded_width + 1;
+        for(uint32 j = 0; j < width; ++j) {
+            row[j] = autotile_cell_terrain(autotiler, i * width + j);
+        }
+    }
+
+    uint32 changed = 0;
+    uint8* masks = mscalloc(width, uint8);
+    for(uint32 r = 0; r < rows; ++r) {
+        uint32 i = first_row + r;
+        const uint8* mid = terrain + (r + 1) * padded_width;
+        autotile_row_masks(mid - padded_width, mid, mid + padded_width, masks, width);
+        ++mid;
+
+        // Only the first and last rows can be partial
+        uint32 j_start = i == first_row ? start % width : 0;
+        uint32 j_end = i == last_row ? (start + count - 1) % width + 1 : width;
+        const tile* row = map->tile_data + i * width;
+        for(uint32 j = j_start; j < j_end; ++j) {
+            if(mid[j] == NO_TERRAIN) {
+                continue;
+            }
+
+            uint16 id = autotiler->luts[mid[j]][masks[j]];
+            if(id != NO_TILE && id != row[j].id) {
+                autotile_write(autotiler, i * width + j, id);
+                ++changed;
+            }
+        }
+    }
+
+    sfree(masks);
+    sfree(terrain);
+
+    return changed;
+}
+
+// Creates an autotiler for map. This enables map's journal if it doesn't have one, to find which tiles have changed between updates.
+// The lookup tables are built from map's current tileset, so create a new autotiler if the tileset changes.
+tile_autotiler tile_autotiler_new(tilemap map) {
+    check_return(map, "Can't create an autotiler without a map", NULL);
+    check_warn(map->set.terrain_count > 0, "Creating an autotiler for a tileset without any terrains");
+
+    if(!map->journal) {
+        tilemap_journal_enable(map, AUTOTILE_JOURNAL_CAPACITY);
+    }
+
+    tile_autotiler autotiler = mscalloc(1, struct tile_autotiler);
+    autotiler->map = map;
+    autotile_build_tables(autotiler, map->set);
+    autotile_sync_size(autotiler);
+    autotiler->version = tilemap_get_version(map);
+
+    return autotiler;
+}
+
+// Frees an autotiler. The map's journal is left enabled.
+void _tile_autotiler_free(tile_autotiler autotiler) {
+    if(autotiler->luts) {
+        sfree(autotiler->luts);
+    }
+    if(autotiler->paint_tiles) {
+        sfree(autotiler->paint_tiles);
+    }
+    if(autotiler->queue) {
+        sfree(autotiler->queue);
+    }
+    sfree(autotiler->tile_terrain);
+    sfree(autotiler->queued);
+    sfree(autotiler);
+}
+
+// Removes the corner bits of mask whose adjacent edges aren't both set, since those corners can't affect which tile is drawn
+uint8 tile_autotiler_reduce_mask(uint8 mask) {
+    if((mask & (AUTOTILE_N | AUTOTILE_E)) != (AUTOTILE_N | AUTOTILE_E)) {
+        mask &= ~AUTOTILE_NE;
+    }
+    if((mask & (AUTOTILE_S | AUTOTILE_E)) != (AUTOTILE_S | AUTOTILE_E)) {
+        mask &= ~AUTOTILE_SE;
+    }
+    if((mask & (AUTOTILE_S | AUTOTILE_W)) != (AUTOTILE_S | AUTOTILE_W)) {
+        mask &= ~AUTOTILE_SW;
+    }
+    if((mask & (AUTOTILE_N | AUTOTILE_W)) != (AUTOTILE_N | AUTOTILE_W)) {
+        mask &= ~AUTOTILE_NW;
+    }
+
+    return mask;
+}
+
+// Paints terrain at [x, y]. The cell and its neighbours get their final tiles on the next update.
+void tile_autotiler_paint(tile_autotiler autotiler, uint16 x, uint16 y, uint8 terrain) {
+    check_return(terrain < autotiler->terrain_count, "Can't paint terrain %d, tileset has %d terrains", , terrain, autotiler->terrain_count);
+    check_return(autotiler->paint_tiles[terrain] != NO_TILE, "Can't paint terrain %d, it has no rules", , terrain);
+    // The map may have been resized since the last update, so go by its current size rather than the autotiler's
+    tilemap map = autotiler->map;
+    check_return(x < map->width && y < map->height, "Can't paint out-of-bounds tile at [%d, %d] in a %dx%d map", , x, y, map->width, map->height);
+
+    // Re-painting the same terrain wouldn't change any tiles, so don't queue any work for it
+    if(autotile_cell_terrain(autotiler, y * map->width + x) != terrain) {
+        tilemap_set_tile(autotiler->map, x, y, autotiler->paint_tiles[terrain]);
+    }
+}
+
+/** @brief Re-resolves the cells around every tile changed since the last update
+ *
+ * Only the 3x3 neighbourhood of each changed tile is resolved. If the journal no longer covers the changes, or the map was resized,
+ * every cell is marked as waiting instead, and the whole map is resolved a row-major range at a time within max_cells.
+ *
+ * @param autotiler The autotiler to update
+ * @param max_cells The most cells to resolve in this call, to keep within a frame budget. Leftover cells are resolved by later updates. 0 means no limit.
+ * @return The number of cells still waiting to be resolved
+ */
+uint32 tile_autotiler_update(tile_autotiler autotiler, uint32 max_cells) {
+    tilemap map = autotiler->map;
+
+    uint32* indices = NULL;
+    uint32 count = tilemap_journal_collect(map, autotiler->version, &indices);
+    if(count == UINT32_MAX || map->width != autotiler->width || map->height != autotiler->height) {
+        // Too much changed to know where, so sweep the whole map instead. This supersedes anything already queued.
+        autotile_sync_size(autotiler);
+        autotiler->sweep_end = autotiler->width * autotiler->height;
+        count = 0;
+    }
+
+    for(uint32 i = 0; i < count; ++i) {
+        int32 x = indices[i] % autotiler->width;
+        int32 y = indices[i] / autotiler->width;
+        for(int32 ny = y - 1; ny <= y + 1; ++ny) {
+            for(int32 nx = x - 1; nx <= x + 1; ++nx) {
+                if(nx >= 0 && ny >= 0 && nx < autotiler->width && ny < autotiler->height) {
+                    autotile_queue(autotiler, ny * autotiler->width + nx);
+                }
+            }
+        }
+    }
+    if(indices) {
+        sfree(indices);
+    }
+
+    // Resolving a cell never changes which terrain it belongs to, so the order doesn't matter
+    uint32 resolved = 0;
+    for(; autotiler->queue_start < autotiler->queue_length && (max_cells == 0 || resolved < max_cells); ++resolved) {
+        uint32 index = autotiler->queue[autotiler->queue_start++];
+        autotiler->queued[index >> 6] &= ~((uint64)1 << (index & 63));
+        autotile_resolve_cell(autotiler, index);
+    }
+    if(autotiler->queue_start == autotiler->queue_length) {
+        autotiler->queue_start = 0;
+        autotiler->queue_length = 0;
+    }
+
+    // Spend whatever budget is left on the sweep
+    uint32 sweep = autotiler->sweep_end - autotiler->sweep_next;
+    if(max_cells != 0 && sweep > max_cells - resolved) {
+        sweep = max_cells - resolved;
+    }
+    autotile_resolve_range(autotiler, autotiler->sweep_next, sweep);
+    autotiler->sweep_next += sweep;
+
+    // The autotiler's own changes don't need resolving again
+    autotiler->version = tilemap_get_version(map);
+
+    return autotiler->queue_length - autotiler->queue_start + autotiler->sweep_end - autotiler->sweep_next;
+}
+
+// Resolves every terrain cell in the map, e.g. after importing it. Returns the number of tiles that changed.
+uint32 tile_autotiler_resolve_all(tile_autotiler autotiler) {
+    tilemap map = autotiler->map;
+    autotile_sync_size(autotiler);
+
+    uint32 changed = autotile_resolve_range(autotiler, 0, map->width * map->height);
+    autotiler->version = tilemap_get_version(map);
+
+    return changed;
+}
@@ -0,0 +1,47 @@
+#ifndef DF_TILES_TILEMAP_AUTOTILE
+#define DF_TILES_TILEMAP_AUTOTILE
+#include "tilemap.h"
+
+// Neighbour bits of a terrain mask
+#define AUTOTILE_N  0x01
+#define AUTOTILE_NE 0x02
+#define AUTOTILE_E  0x04
+#define AUTOTILE_SE 0x08
+#define AUTOTILE_S  0x10
+#define AUTOTILE_SW 0x20
+#define AUTOTILE_W  0x40
+#define AUTOTILE_NW 0x80
+
+// Picks tiles for a map's terrain cells from the terrain rules in its tileset, based on which neighbours share the terrain.
+// Cells whose tile isn't used by any terrain are left alone. Neighbours outside the map count as sharing the terrain.
+declarep(struct, tile_autotiler)
+
+// Creates an autotiler for map. This enables map's journal if it doesn't have one, to find which tiles have changed between updates.
+// The lookup tables are built from map's current tileset, so create a new autotiler if the tileset changes.
+tile_autotiler tile_autotiler_new(tilemap map);
+
+// Frees an autotiler. The map's journal is left enabled.
+#define tile_autotiler_free(autotiler) { _tile_autotiler_free(autotiler); autotiler = NULL; }
+void _tile_autotiler_free(tile_autotiler autotiler);
+
+// Removes the corner bits of mask whose adjacent edges aren't both set, since those corners can't affect which tile is drawn
+uint8 tile_autotiler_reduce_mask(uint8 mask);
+
+// Paints terrain at [x, y]. The cell and its neighbours get their final tiles on the next update.
+void tile_autotiler_paint(tile_autotiler autotiler, uint16 x, uint16 y, uint8 terrain);
+
+/** @brief Re-resolves the cells around every tile changed since the last update
+ *
+ * Only the 3x3 neighbourhood of each changed tile is resolved. If the journal no longer covers the changes, or the map was resized,
+ * every cell is marked as waiting instead, and the whole map is resolved a row-major range at a time within max_cells.
+ *
+ * @param autotiler The autotiler to update
+ * @param max_cells The most cells to resolve in this call, to keep within a frame budget. Leftover cells are resolved by later updates. 0 means no limit.
+ * @return The number of cells still waiting to be resolved
+ */
+uint32 tile_autotiler_update(tile_autotiler autotiler, uint32 max_cells);
+
+// Resolves every terrain cell in the map, e.g. after importing it. Returns the number of tiles that changed.
+uint32 tile_autotiler_resolve_all(tile_autotiler autotiler);
+
+#endif
@@ -0,0 +1,324 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tilemap_delta.h"
+
+#include "core/check.h"
+
+#include <stdlib.h>
+
+#include "tilemap.priv.h"
+
+// Set when the delta covers every tile in the map, rather than just changed ones
+#define DELTA_KEYFRAME 1
+
+typedef struct delta_writer {
+    ubyte* data;
+    size_t length;
+    size_t capacity;
+} delta_writer;
+
+typedef struct delta_reader {
+    const ubyte* data;
+    size_t length;
+    size_t position;
+    bool valid;
+} delta_reader;
+
+static void delta_reserve(delta_writer* writer, size_t extra) {
+    if(writer->length + extra > writer->capacity) {
+        writer->capacity = writer->capacity * 2 > writer->length + extra ? writer->capacity * 2 : writer->length + extra;
+        writer->data = srealloc(writer->data, writer->capacity);
+    }
+}
+
+// Writes value using 7 bits per byte, so that small values take a single byte
+static void delta_write_varint(delta_writer* writer, uint32 value) {
+    delta_reserve(writer, 5);
+    while(value >= 0x80) {
+        writer->data[writer->length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    writer->data[writer->length++] = value;
+}
+
+static void delta_write_tile(delta_writer* writer, tile value) {
+    delta_reserve(writer, 3);
+    writer->data[writer->length++] = value.id & 0xFF;
+    writer->data[writer->length++] = value.id >> 8;
+    writer->data[writer->length++] = value.mask;
+}
+
+// Writes a span of tiles, collapsing runs of identical ones
+static void delta_write_span(delta_writer* writer, const tile* tiles, uint32 length) {
+    delta_write_varint(writer, length);
+
+    for(uint32 i = 0; i < length;) {
+        uint32 j = i + 1;
+        while(j < length && tiles[j].id == tiles[i].id && tiles[j].mask == tiles[i].mask) {
+            ++j;
+        }
+
+        delta_write_varint(writer, j - i);
+        delta_write_tile(writer, tiles[i]);
+        i = j;
+    }
+}
+
+static uint32 delta_read_varint(delta_reader* reader) {
+    uint32 value = 0;
+    for(uint8 shift = 0; shift < 35 && reader->position < reader->length; shift += 7) {
+        ubyte b = reader->data[reader->position++];
+        value |= (uint32)(b & 0x7F) << shift;
+        if(!(b & 0x80)) {
+            return value;
+        }
+    }
+
+    reader->valid = false;
+    return 0;
+}
+
+static tile delta_read_tile(delta_reader* reader) {
+    if(reader->position + 3 > reader->length) {
+        reader->valid = false;
+        return (tile){0};
+    }
+
+    const ubyte* b = reader->data + reader->position;
+    reader->position += 3;
+
+    return (tile){ .id = b[0] | (b[1] << 8), .mask = b[2] };
+}
+
+// Reads the spans in a delta. If map is NULL, the data is only validated.
+static bool delta_read_spans(delta_reader* reader, tilemap map, uint32 area, uint32 tile_count) {
+    uint32 spans = delta_read_varint(reader);
+    uint32 cell = 0;
+
+    for(uint32 i = 0; i < spans && reader->valid; ++i) {
+        cell += delta_read_varint(reader);
+        uint32 length = delta_read_varint(reader);
+        if(!reader->valid || cell > area || length > area - cell) {
+            return false;
+        }
+
+        if(map) {
+            tilemap_snapshot_preserve(map, cell, length);
+        }
+
+        uint32 end = cell + length;
+        while(cell < end) {
+            uint32 run = delta_read_varint(reader);
+            tile value = delta_read_tile(reader);
+            if(!reader->valid || run == 0 || run > end - cell || (value.id != NO_TILE && value.id >= tile_count)) {
+                return false;
+            }
+
+            if(map) {
+                for(uint32 j = 0; j < run; ++j) {
+                    tilemap_write_tile(map, cell + j, value);
+                }
+            }
+            cell += run;
+        }
+    }
+
+    return reader->valid;
+}
+
+static int compare_indices(const void* a, const void* b) {
+    uint32 lhs = *(const uint32*)a;
+    uint32 rhs = *(const uint32*)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+// Starts recording which tiles of map change, keeping track of up to capacity changes
+void tilemap_journal_enable(tilemap map, uint32 capacity) {
+    check_return(capacity > 0, "Can't create a tilemap journal with no capacity", );
+
+    tilemap_journal_disable(map);
+    map->journal = mscalloc(capacity, uint32);
+    map->journal_capacity = capacity;
+    map->journal_base = map->version;
+}
+
+// Stops recording changes to map
+void tilemap_journal_disable(tilemap map) {
+    if(map->journal) {
+        sfree(map->journal);
+        map->journal = NULL;
+    }
+    map->journal_capacity = 0;
+}
+
+// Returns the number of changes made to map so far. Pass this to tilemap_delta_encode later on to get the changes made after this point.
+uint32 tilemap_get_version(tilemap map) {
+    return map->version;
+}
+
+// Bumps map's version, and records the change to tile index in its journal if it has one
+void tilemap_journal_record(tilemap map, uint32 index) {
+    if(map->journal) {
+        map->journal[map->version % map->journal_capacity] = index;
+    }
+    ++map->version;
+}
+
+// Bumps map's version once for each of count consecutive tiles from index, and records them in its journal if it has one
+void tilemap_journal_record_span(tilemap map, uint32 index, uint32 count) {
+    if(map->journal) {
+        // Only the newest journal_capacity entries can ever be read back
+        uint32 skip = count > map->journal_capacity ? count - map->journal_capacity : 0;
+        for(uint32 i = skip; i < count; ++i) {
+            map->journal[(map->version + i) % map->journal_capacity] = index + i;
+        }
+    }
+    map->version += count;
+}
+
+// Forgets every recorded change, for when the map's layout changes
+void tilemap_journal_reset(tilemap map) {
+    ++map->version;
+    map->journal_base = map->version;
+}
+
+// Collects the sorted, unique indices of tiles changed since version into indices, and returns how many there are.
+// Returns UINT32_MAX if the journal no longer covers that version. The caller must free indices.
+uint32 tilemap_journal_collect(tilemap map, uint32 version, uint32** indices) {
+    *indices = NULL;
+    if(version == map->version) {
+        return 0;
+    }
+
+    // Versions wrap around, so compare distances back from the current version rather than the versions themselves
+    uint32 changes = map->version - version;
+    if(!map->journal || changes > map->version - map->journal_base || changes > map->journal_capacity) {
+        return UINT32_MAX;
+    }
+
+    uint32* result = mscalloc(changes, uint32);
+    for(uint32 i = 0; i < changes; ++i) {
+        result[i] = map->journal[(version + i) % map->journal_capacity];
+    }
+    qsort(result, changes, sizeof(uint32), compare_indices);
+
+    uint32 count = 1;
+    for(uint32 i = 1; i < changes; ++i) {
+        if(result[i] != result[count - 1]) {
+            result[count++] = result[i];
+        }
+    }
+
+    *indices = result;
+    return count;
+}
+
+/** @brief Encodes the tiles of map that have changed since version
+ *
+ * Changed tiles are stored as row-major spans, with runs of identical tiles in each span collapsed.
+ * If the journal doesn't go back far enough, the whole map is encoded instead.
+ *
+ * @param map The map to encode
+ * @param version The version that the receiving map is at
+ * @param length Receives the length of the encoded data, in bytes
+ * @return The encoded data, which must be freed by the caller
+ */
+ubyte* tilemap_delta_encode(tilemap map, uint32 version, size_t* length) {
+    uint32* indices = NULL;
+    uint32 count = tilemap_journal_collect(map, version, &indices);
+    bool keyframe = count == UINT32_MAX;
+
+    delta_writer writer = {0};
+    delta_reserve(&writer, 32);
+    writer.data[writer.length++] = keyframe ? DELTA_KEYFRAME : 0;
+    delta_write_varint(&writer, version);
+    delta_write_varint(&writer, map->version);
+    delta_write_varint(&writer, map->width);
+    delta_write_varint(&writer, map->height);
+
+    if(keyframe) {
+        delta_write_varint(&writer, 1);
+        delta_write_varint(&writer, 0);
+        delta_write_span(&writer, map->tile_data, map->width * map->height);
+    } else {
+        uint32 spans = 0;
+        for(uint32 i = 0; i < count; ++i) {
+            if(i == 0 || indices[i] != indices[i - 1] + 1) {
+                ++spans;
+            }
+        }
+        delta_write_varint(&writer, spans);
+
+        // Each span starts with the number of untouched tiles since the end of the previous one
+        uint32 end = 0;
+        for(uint32 i = 0; i < count;) {
+            uint32 j = i + 1;
+            while(j < count && indices[j] == indices[j - 1] + 1) {
+                ++j;
+            }
+
+            delta_write_varint(&writer, indices[i] - end);
+            delta_write_span(&writer, map->tile_data + indices[i], j - i);
+            end = indices[i] + (j - i);
+            i = j;
+        }
+
+        if(indices) {
+            sfree(indices);
+        }
+    }
+
+    if(length) {
+        *length = writer.length;
+    }
+
+    return writer.data;
+}
+
+/** @brief Applies data from tilemap_delta_encode to map
+ *
+ * Deltas other than keyframes only describe the changes since a particular version of the sender's map,
+ * so they're rejected unless that's the version that map was last brought up to.
+ * Keyframes are rejected if they're older than the version that map is at, so that late ones can't roll it back.
+ *
+ * @param map The map to apply the delta to
+ * @param data The encoded delta
+ * @param length The length of data, in bytes
+ * @param version The sender's version that map is currently at. If the delta is applied, this receives the sender's version that map is now at.
+ * @return True if the delta was applied, or false if it's invalid, was encoded against a different version, or doesn't match map's dimensions
+ */
+bool tilemap_delta_apply(tilemap map, const ubyte* data, size_t length, uint32* version) {
+    check_return(data && length > 0, "Can't apply an empty tilemap delta", false);
+    check_return(version, "Can't apply a tilemap delta without tracking the sender's version", false);
+
+    delta_reader reader = { .data = data, .length = length, .position = 1, .valid = true };
+    bool keyframe = data[0] & DELTA_KEYFRAME;
+    uint32 from = delta_read_varint(&reader);
+    uint32 to = delta_read_varint(&reader);
+    uint32 width = delta_read_varint(&reader);
+    uint32 height = delta_read_varint(&reader);
+    check_return(reader.valid && width > 0 && height > 0 && width <= UINT16_MAX && height <= UINT16_MAX, "Tilemap delta has an invalid header", false);
+
+    // Duplicated, reordered or skipped deltas would leave the map in a state the sender never had
+    check_return(keyframe || from == *version, "Can't apply a tilemap delta from version %u to a map at version %u", false, from, *version);
+    check_return(!keyframe || (int32)(to - *version) >= 0, "Can't apply a tilemap keyframe for version %u to a map that's already at version %u", false, to, *version);
+    check_return(keyframe || (width == map->width && height == map->height), "Can't apply a %dx%d tilemap delta to a %dx%d map", false, width, height, map->width, map->height);
+
+    // Validate everything first, so that bad data never leaves the map half-updated
+    size_t spans_start = reader.position;
+    uint32 tile_count = map->set.width * map->set.height;
+    check_return(delta_read_spans(&reader, NULL, width * height, tile_count), "Tilemap delta is invalid", false);
+
+    if(width != map->width || height != map->height) {
+        tilemap_resize(map, width, height);
+    }
+
+    reader.position = spans_start;
+    if(!delta_read_spans(&reader, map, width * height, tile_count)) {
+        return false;
+    }
+    *version = to;
+
+    return true;
+}
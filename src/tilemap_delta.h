@@ -0,0 +1,42 @@
+#ifndef DF_TILES_TILEMAP_DELTA
+#define DF_TILES_TILEMAP_DELTA
+#include "tilemap.h"
+
+#include <stddef.h>
+
+// Starts recording which tiles of map change, keeping track of up to capacity changes
+void tilemap_journal_enable(tilemap map, uint32 capacity);
+
+// Stops recording changes to map
+void tilemap_journal_disable(tilemap map);
+
+// Returns the number of changes made to map so far. Pass this to tilemap_delta_encode later on to get the changes made after this point.
+uint32 tilemap_get_version(tilemap map);
+
+/** @brief Encodes the tiles of map that have changed since version
+ *
+ * Changed tiles are stored as row-major spans, with runs of identical tiles in each span collapsed.
+ * If the journal doesn't go back far enough, the whole map is encoded instead.
+ *
+ * @param map The map to encode
+ * @param version The version that the receiving map is at
+ * @param length Receives the length of the encoded data, in bytes
+ * @return The encoded data, which must be freed by the caller
+ */
+ubyte* tilemap_delta_encode(tilemap map, uint32 version, size_t* length);
+
+/** @brief Applies data from tilemap_delta_encode to map
+ *
+ * Deltas other than keyframes only describe the changes since a particular version of the sender's map,
+ * so they're rejected unless that's the version that map was last brought up to.
+ * Keyframes are rejected if they're older than the version that map is at, so that late ones can't roll it back.
+ *
+ * @param map The map to apply the delta to
+ * @param data The encoded delta
+ * @param length The length of data, in bytes
+ * @param version The sender's version that map is currently at. If the delta is applied, this receives the sender's version that map is now at.
+ * @return True if the delta was applied, or false if it's invalid, was encoded against a different version, or doesn't match map's dimensions
+ */
+bool tilemap_delta_apply(tilemap map, const ubyte* data, size_t length, uint32* version);
+
+#endif
@@ -15,35 +15,73 @@
 
 // Loads a tilemap from path, or returns NULL if an error occurs
 tilemap load_tilemap(const char* path) {
+    FILE* infile = fopen(path, "re");
+
+    check_return(infile, "Can't open tilemap file at %s", NULL, path);
+
+    tilemap map = fread_tilemap(infile, path, NULL, NULL);
+    if(map != NULL) {
+        map->asset_path = nstrdup(path);
+    }
+
+    fclose(infile);
+
+    return map;
+}
+
+// Saves a tilemap to path. tileset_file should point to the relative location for the map's tileset (this tileset file does not need to be present, and will not be accessed until the map is loaded).
+void save_tilemap(const char* path, tilemap map) {
+    FILE* outfile = fopen(path, "we");
+
+    check_return(outfile != NULL, "Failed to save tilemap: Can't open file at %s", , path);
+
+    fwrite_tilemap(outfile, path, map);
+
+    fclose(outfile);
+}
+
+// Saves a snapshot of a tilemap to path. Unlike save_tilemap, this is safe to call from a worker thread while the map is being edited.
+void save_tilemap_snapshot(const char* path, tilemap_snapshot snapshot) {
+    FILE* outfile = fopen(path, "we");
+
+    check_return(outfile != NULL, "Failed to save tilemap: Can't open file at %s", , path);
+
+    fwrite_tilemap_snapshot(outfile, path, snapshot);
+
+    fclose(outfile);
+}
+
+/** @brief Reads a tilemap from the current position of an open file
+ *
+ * @param infile The file to read from
+ * @param path The filepath to use for resolving the relative tileset path
+ * @param fn Callback for providing the tileset. Set to NULL to load it with load_tileset.
+ * @param user User data to pass to fn
+ * @return The tilemap, or NULL if an error occurs
+ */
+tilemap fread_tilemap(FILE* infile, const char* path, tileset_load_fn fn, void* user) {
     uint16 w, h;
     tile t;
     ssize_t plen;
     char* tileset_path = NULL;
 
-    FILE* infile = fopen(path, "re");
-
-    check_return(infile, "Can't open tilemap file at %s", NULL, path);
-    
     size_t elements = fread(&w, sizeof(w), 1, infile) + fread(&h, sizeof(h), 1, infile) + fread(&plen, sizeof(plen), 1, infile);
-    if(check_error(elements == 3, "Can't load tilemap %s: Invalid Header", path)) {
-        fclose(infile);
-        return NULL;
-    }
+    check_return(elements == 3, "Can't load tilemap %s: Invalid Header", NULL, path);
 
     if(plen > 0) {
-        tileset_path = mscalloc(plen + 1, char);
-        size_t read = fread(tileset_path, sizeof(char), plen, infile);
+        char* relative_path = mscalloc(plen + 1, char);
+        size_t read = fread(relative_path, sizeof(char), plen, infile);
         if(check_error(read == plen, "Can't load tilemap %s: Size mismatch in tileset path (%d != %d)", path, read, plen)) {
-            fclose(infile);
+            sfree(relative_path);
             return NULL;
         }
-        tileset_path = combine_paths(get_folder(path), tileset_path, true);
+        tileset_path = combine_paths(get_folder(path), relative_path, true);
+        sfree(relative_path);
     }
 
     tilemap map = tilemap_new(w, h);
-    map->asset_path = nstrdup(path);
     if(tileset_path != NULL) {
-        tilemap_set_tileset(map, load_tileset(tileset_path));
+        tilemap_set_tileset(map, fn != NULL ? fn(tileset_path, user) : load_tileset(tileset_path));
 
         for(int i = 0; i < h; ++i) {
             for(int j = 0; j < w; ++j) {
@@ -53,38 +91,59 @@ tilemap load_tilemap(const char* path) {
                 tilemap_set_tile(map, j, i, t.id);
             }
         }
+        sfree(tileset_path);
     }
 
-    fclose(infile);
-
     return map;
 }
 
-// Saves a tilemap to path. tileset_file should point to the relative location for the map's tileset (this tileset file does not need to be present, and will not be accessed until the map is loaded).
-void save_tilemap(const char* path, tilemap map) {
-    FILE* outfile = fopen(path, "we");
+// Writes the dimensions and relative tileset path of a tilemap, and returns the number of header fields written
+static size_t fwrite_tilemap_header(FILE* outfile, const char* path, uint16 width, uint16 height, const char* tileset_path) {
+    size_t written = fwrite(&width, sizeof(width), 1, outfile);
+    written += fwrite(&height, sizeof(height), 1, outfile);
 
-    check_return(outfile != NULL, "Failed to save tilemap: Can't open file at %s", , path);
+    ssize_t len = 0;
+    if(tileset_path != NULL) {
+        char* t_path = get_relative_base(path, tileset_path);
+        len = strlen(tileset_path) - strlen(t_path);
+        written += fwrite(&(len), sizeof(len), 1, outfile);
+
+        fwrite(tileset_path + strlen(t_path), sizeof(char), len, outfile);
+        sfree(t_path);
+    } else {
+        // If there's no tileset, there's nothing to write.
+        written += fwrite(&(len), sizeof(len), 1, outfile);
+    }
 
-    fwrite(&(map->width), sizeof(map->width), 1, outfile);
-    fwrite(&(map->height), sizeof(map->height), 1, outfile);
+    return written;
+}
 
-    ssize_t len = 0;
+// Writes a tilemap at the current position of an open file. path is used to make the tileset path relative. Returns false if an error occurs.
+bool fwrite_tilemap(FILE* outfile, const char* path, tilemap map) {
+    size_t written = fwrite_tilemap_header(outfile, path, map->width, map->height, map->set.asset_path);
     if(map->set.asset_path != NULL) {
-        char* t_path = get_relative_base(path, map->set.asset_path);
-        len = strlen(map->set.asset_path) - strlen(t_path);
-        fwrite(&(len), sizeof(len), 1, outfile);
+        fwrite(map->tile_data, sizeof(tile), map->width * map->height, outfile);
+    }
 
-        fwrite(map->set.asset_path + strlen(t_path), sizeof(char), len, outfile);
-        sfree(t_path);
+    return !check_error(written == 3 && !ferror(outfile), "Failed to write tilemap %s", path);
+}
 
-        for(int i = 0; i < map->width * map->height; ++i) {
-            fwrite(map->tile_data, sizeof(tile), map->width * map->height, outfile);
+// Writes a snapshot of a tilemap at the current position of an open file. path is used to make the tileset path relative. Returns false if an error occurs.
+bool fwrite_tilemap_snapshot(FILE* outfile, const char* path, tilemap_snapshot snapshot) {
+    uint16 width = tilemap_snapshot_get_width(snapshot);
+    uint16 height = tilemap_snapshot_get_height(snapshot);
+    const char* tileset_path = tilemap_snapshot_get_tileset_path(snapshot);
+
+    size_t written = fwrite_tilemap_header(outfile, path, width, height, tileset_path);
+    if(tileset_path != NULL) {
+        // Copy out a page at a time, so the map is never locked for long
+        tile buffer[TILEMAP_PAGE_TILES];
+        for(uint32 i = 0; i < width * height; i += TILEMAP_PAGE_TILES) {
+            uint32 count = width * height - i < TILEMAP_PAGE_TILES ? width * height - i : TILEMAP_PAGE_TILES;
+            tilemap_snapshot_read(snapshot, i, count, buffer);
+            fwrite(buffer, sizeof(tile), count, outfile);
         }
-    } else {
-        // If there's no tileset, there's nothing to write.
-        fwrite(&(len), sizeof(len), 1, outfile);
     }
 
-    fclose(outfile);
+    return !check_error(written == 3 && !ferror(outfile), "Failed to write tilemap %s", path);
 }
@@ -2,10 +2,34 @@
 #define DF_TILES_TILEMAP_IO
 #include "tilemap.h"
 
+#include <stdio.h>
+
+/** Callback function for providing the tileset referenced by a tilemap file */
+delegate(tileset, tileset_load_fn, const char*, void*);
+
 // Loads a tilemap from path, or returns NULL if an error occurs
 tilemap load_tilemap(const char* path);
 
 // Saves a tilemap to path. tileset_file should point to the relative location for the map's tileset (this tileset file does not need to be present, and will not be accessed until the map is loaded).
 void save_tilemap(const char* path, tilemap map);
 
+// Saves a snapshot of a tilemap to path. Unlike save_tilemap, this is safe to call from a worker thread while the map is being edited.
+void save_tilemap_snapshot(const char* path, tilemap_snapshot snapshot);
+
+/** @brief Reads a tilemap from the current position of an open file
+ *
+ * @param infile The file to read from
+ * @param path The filepath to use for resolving the relative tileset path
+ * @param fn Callback for providing the tileset. Set to NULL to load it with load_tileset.
+ * @param user User data to pass to fn
+ * @return The tilemap, or NULL if an error occurs
+ */
+tilemap fread_tilemap(FILE* infile, const char* path, tileset_load_fn fn, void* user);
+
+// Writes a tilemap at the current position of an open file. path is used to make the tileset path relative. Returns false if an error occurs.
+bool fwrite_tilemap(FILE* outfile, const char* path, tilemap map);
+
+// Writes a snapshot of a tilemap at the current position of an open file. path is used to make the tileset path relative. Returns false if an error occurs.
+bool fwrite_tilemap_snapshot(FILE* outfile, const char* path, tilemap_snapshot snapshot);
+
 #endif
@@ -0,0 +1,373 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tilemap.h"
+
+#include "core/check.h"
+#include "math/matrix.h"
+
+#include <math.h>
+
+#include "tilemap.priv.h"
+
+#define LOD_POSITION_BUFFER 0
+#define LOD_UV_BUFFER 1
+
+// GL state that baking overwrites, and needs to put back afterwards
+typedef struct lod_gl_state {
+    GLint framebuffer;
+    GLint viewport[4];
+    GLint scissor_box[4];
+    GLfloat clear_color[4];
+    GLboolean blend;
+    GLboolean scissor;
+} lod_gl_state;
+
+static lod_gl_state lod_save_state() {
+    lod_gl_state state;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &state.framebuffer);
+    glGetIntegerv(GL_VIEWPORT, state.viewport);
+    glGetIntegerv(GL_SCISSOR_BOX, state.scissor_box);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, state.clear_color);
+    state.blend = glIsEnabled(GL_BLEND);
+    state.scissor = glIsEnabled(GL_SCISSOR_TEST);
+
+    return state;
+}
+
+static void lod_restore_state(lod_gl_state state) {
+    glBindFramebuffer(GL_FRAMEBUFFER, state.framebuffer);
+    glViewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+    glScissor(state.scissor_box[0], state.scissor_box[1], state.scissor_box[2], state.scissor_box[3]);
+    glClearColor(state.clear_color[0], state.clear_color[1], state.clear_color[2], state.clear_color[3]);
+    if(state.blend) {
+        glEnable(GL_BLEND);
+    } else {
+        glDisable(GL_BLEND);
+    }
+    if(state.scissor) {
+        glEnable(GL_SCISSOR_TEST);
+    } else {
+        glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+// Converts a tile coordinate to a pixel coordinate in the baked texture
+static GLint lod_to_pixels(tilemap_lod* lod, uint32 tiles) {
+    return (GLint)floorf(tiles * lod->scale);
+}
+
+// Creates a texture that can be rendered to
+static gltex lod_texture_new(GLint width, GLint height, bool mipmaps) {
+    gltex tex = { .type = GL_TEXTURE_2D, .width = width, .height = height };
+
+    glGenTextures(1, &tex.handle);
+    glBindTexture(GL_TEXTURE_2D, tex.handle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+    return tex;
+}
+
+// Draws count points through the tilemap shader. Positions are in tiles, and each point expands to a dims-sized quad.
+static void lod_draw_points(GLuint buffers[2], shader s, gltex tex, const float* positions, const aabb_2d* uvs, uint32 count, vec2 dims, mat4 model, mat4 view) {
+    glUseProgram(s.id);
+    shader_bind_uniform_name(s, "u_transform", model);
+    shader_bind_uniform_name(s, "u_view", view);
+    shader_bind_uniform_name(s, "u_dims", dims);
+    shader_bind_uniform_texture_name(s, "u_texture", tex, GL_TEXTURE0);
+
+    GLuint pos_attrib = glGetAttribLocation(s.id, "i_pos");
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[LOD_POSITION_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(float) * 3, positions, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(pos_attrib);
+    glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    GLuint uv_attrib = glGetAttribLocation(s.id, "i_uv");
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[LOD_UV_BUFFER]);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(aabb_2d), uvs, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(uv_attrib);
+    glVertexAttribPointer(uv_attrib, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    glDrawArrays(GL_POINTS, 0, count);
+
+    glDisableVertexAttribArray(pos_attrib);
+    glDisableVertexAttribArray(uv_attrib);
+}
+
+// Returns a projection that maps the tiles in [x0, y0]-[x1, y1] onto the whole viewport
+static mat4 lod_region_projection(tilemap map, uint32 x0, uint32 y0, uint32 x1, uint32 y1) {
+    vec2 dims = tileset_get_tile_dims(map->set);
+    float left = x0 * dims.x;
+    float right = x1 * dims.x;
+    float bottom = y0 * dims.y;
+    float top = y1 * dims.y;
+
+    mat4 proj = mat4_ident;
+    proj.data[0] = 2.0f / (right - left);
+    proj.data[5] = 2.0f / (top - bottom);
+    proj.data[12] = -(right + left) / (right - left);
+    proj.data[13] = -(top + bottom) / (top - bottom);
+
+    return proj;
+}
+
+// Renders the tiles in [x0, y0]-[x1, y1] into the current framebuffer's viewport
+static void lod_render_region(tilemap map, GLuint buffers[2], shader s, uint32 x0, uint32 y0, uint32 x1, uint32 y1) {
+    uint32 area = (x1 - x0) * (y1 - y0);
+    float* positions = mscalloc(area * 3, float);
+    aabb_2d* uvs = mscalloc(area, aabb_2d);
+
+    uint32 count = 0;
+    for(uint32 i = y0; i < y1; ++i) {
+        const tile* row = map->tile_data + i * map->width;
+        for(uint32 j = x0; j < x1; ++j) {
+            if(row[j].id != NO_TILE) {
+                positions[count * 3] = j;
+                positions[count * 3 + 1] = i;
+                positions[count * 3 + 2] = 0;
+                uvs[count] = tileset_get_tile(map->set, row[j].id);
+                ++count;
+            }
+        }
+    }
+
+    if(count > 0) {
+        lod_draw_points(buffers, s, map->set.tex, positions, uvs, count, tileset_get_tile_dims(map->set), mat4_ident, lod_region_projection(map, x0, y0, x1, y1));
+    }
+
+    sfree(positions);
+    sfree(uvs);
+}
+
+// Draws the baked texture as a single quad covering the whole map
+static void lod_draw_cached(tilemap map, shader s, mat4 model, mat4 view) {
+    float position[3] = { 0, 0, 0 };
+    aabb_2d uv = { .position = { .x = 0, .y = 0 }, .dimensions = { .x = 1, .y = 1 } };
+    vec2 dims = tileset_get_tile_dims(map->set);
+    dims.x *= map->width;
+    dims.y *= map->height;
+
+    lod_draw_points(map->lod->buffers, s, map->lod->tex, position, &uv, 1, dims, model, view);
+}
+
+// Creates the cache texture if needed, and re-bakes any chunks that have changed
+static void lod_update(tilemap map, shader s) {
+    tilemap_lod* lod = map->lod;
+
+    if(lod->tex.handle == 0) {
+        GLint max_size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+        // Keep the cache within the texture size limit by lowering its resolution
+        float limit = fminf((float)max_size / map->width, (float)max_size / map->height);
+        if(check_warn(lod->scale <= limit, "Tilemap LOD scale %f is too large for a %dx%d map, clamping to %f", lod->scale, map->width, map->height, limit)) {
+            lod->scale = limit;
+        }
+
+        GLint width = lod_to_pixels(lod, map->width);
+        GLint height = lod_to_pixels(lod, map->height);
+        lod->tex = lod_texture_new(width > 0 ? width : 1, height > 0 ? height : 1, true);
+
+        glGenFramebuffers(1, &lod->framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, lod->framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lod->tex.handle, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        lod->chunks_x = (map->width + lod->chunk_size - 1) / lod->chunk_size;
+        lod->chunks_y = (map->height + lod->chunk_size - 1) / lod->chunk_size;
+        lod->chunk_dirty = mscalloc(lod->chunks_x * lod->chunks_y, bool);
+        for(uint32 i = 0; i < lod->chunks_x * lod->chunks_y; ++i) {
+            lod->chunk_dirty[i] = true;
+        }
+        lod->any_dirty = true;
+    }
+
+    if(!lod->any_dirty) {
+        return;
+    }
+
+    lod_gl_state state = lod_save_state();
+    glBindFramebuffer(GL_FRAMEBUFFER, lod->framebuffer);
+    glDisable(GL_BLEND);
+    glEnable(GL_SCISSOR_TEST);
+    glClearColor(0, 0, 0, 0);
+
+    for(uint16 i = 0; i < lod->chunks_y; ++i) {
+        for(uint16 j = 0; j < lod->chunks_x; ++j) {
+            if(!lod->chunk_dirty[i * lod->chunks_x + j]) {
+                continue;
+            }
+            lod->chunk_dirty[i * lod->chunks_x + j] = false;
+
+            uint32 x0 = j * lod->chunk_size;
+            uint32 y0 = i * lod->chunk_size;
+            uint32 x1 = x0 + lod->chunk_size < map->width ? x0 + lod->chunk_size : map->width;
+            uint32 y1 = y0 + lod->chunk_size < map->height ? y0 + lod->chunk_size : map->height;
+
+            GLint px = lod_to_pixels(lod, x0);
+            GLint py = lod_to_pixels(lod, y0);
+            GLint pw = lod_to_pixels(lod, x1) - px;
+            GLint ph = lod_to_pixels(lod, y1) - py;
+            if(pw <= 0 || ph <= 0) {
+                continue;
+            }
+
+            glViewport(px, py, pw, ph);
+            glScissor(px, py, pw, ph);
+            glClear(GL_COLOR_BUFFER_BIT);
+            lod_render_region(map, lod->buffers, s, x0, y0, x1, y1);
+        }
+    }
+
+    lod_restore_state(state);
+    lod->any_dirty = false;
+
+    glBindTexture(GL_TEXTURE_2D, lod->tex.handle);
+    glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+// Enables level-of-detail drawing. Once a tile covers fewer than threshold pixels on screen, tilemap_draw renders a cached texture baked at scale pixels per tile instead.
+// The cache is split into chunks of chunk_size tiles, which are only re-baked when their tiles change. Set threshold to 0 to disable.
+void tilemap_set_lod(tilemap map, float threshold, uint16 chunk_size, float scale) {
+    tilemap_lod_free(map);
+    if(threshold <= 0) {
+        return;
+    }
+
+    check_return(chunk_size > 0, "Tilemap LOD chunk size must be non-zero", );
+    check_return(scale > 0, "Tilemap LOD scale must be positive, got %f", , scale);
+
+    map->lod = mscalloc(1, tilemap_lod);
+    map->lod->threshold = threshold;
+    map->lod->scale = scale;
+    map->lod->chunk_size = chunk_size;
+    glGenBuffers(2, map->lod->buffers);
+}
+
+// Renders the whole map into a new width x height texture. This uses the level-of-detail cache when it's enabled. The caller is responsible for cleaning up the texture.
+gltex tilemap_bake_minimap(tilemap map, uint16 width, uint16 height) {
+    check_return(width * height != 0, "Trying to bake a minimap with the invalid dimensions [%dx%d]", (gltex){0}, width, height);
+
+    // Make sure the tile data is current before rendering
+    tilemap_get_mesh(map);
+
+    shader s = get_tilemap_shader();
+    gltex tex = lod_texture_new(width, height, false);
+
+    GLuint buffers[2] = {0};
+    if(map->lod) {
+        lod_update(map, s);
+    } else {
+        glGenBuffers(2, buffers);
+    }
+
+    lod_gl_state state = lod_save_state();
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex.handle, 0);
+    glViewport(0, 0, width, height);
+    glDisable(GL_BLEND);
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if(map->lod) {
+        // Downsampling the cache is a single quad, rather than one per tile
+        lod_draw_cached(map, s, mat4_ident, lod_region_projection(map, 0, 0, map->width, map->height));
+    } else {
+        lod_render_region(map, buffers, s, 0, 0, map->width, map->height);
+        glDeleteBuffers(2, buffers);
+    }
+
+    lod_restore_state(state);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    return tex;
+}
+
+// Marks the cached chunk containing [x, y] as needing a re-bake
+void tilemap_lod_mark(tilemap map, uint16 x, uint16 y) {
+    if(!map->lod || !map->lod->chunk_dirty) {
+        return;
+    }
+
+    map->lod->chunk_dirty[(y / map->lod->chunk_size) * map->lod->chunks_x + x / map->lod->chunk_size] = true;
+    map->lod->any_dirty = true;
+}
+
+// Marks the cached chunks covering count consecutive tiles from index as needing a re-bake
+void tilemap_lod_mark_span(tilemap map, uint32 index, uint32 count) {
+    if(!map->lod || !map->lod->chunk_dirty || count == 0) {
+        return;
+    }
+
+    uint32 end = index + count - 1;
+    for(uint32 y = index / map->width; y <= end / map->width; ++y) {
+        uint32 x0 = y == index / map->width ? index % map->width : 0;
+        uint32 x1 = y == end / map->width ? end % map->width : map->width - 1u;
+        bool* row = map->lod->chunk_dirty + (y / map->lod->chunk_size) * map->lod->chunks_x;
+        for(uint32 x = x0 / map->lod->chunk_size; x <= x1 / map->lod->chunk_size; ++x) {
+            row[x] = true;
+        }
+    }
+    map->lod->any_dirty = true;
+}
+
+// Drops all cached chunks, so that they're re-created on the next draw
+void tilemap_lod_invalidate(tilemap map) {
+    if(!map->lod) {
+        return;
+    }
+
+    if(map->lod->chunk_dirty) {
+        sfree(map->lod->chunk_dirty);
+        map->lod->chunk_dirty = NULL;
+    }
+    if(map->lod->framebuffer) {
+        glDeleteFramebuffers(1, &map->lod->framebuffer);
+        map->lod->framebuffer = 0;
+    }
+    if(map->lod->tex.handle) {
+        gltex_cleanup(&map->lod->tex);
+        map->lod->tex = (gltex){0};
+    }
+}
+
+// Draws the cached texture if map is zoomed out past its threshold. Returns false if the tiles should be drawn instead.
+bool tilemap_lod_draw(tilemap map, shader s, mat4 model, mat4 view) {
+    if(!map->lod) {
+        return false;
+    }
+
+    // Work out how many pixels a tile covers on screen from the horizontal scale of both matrices
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    float model_scale = sqrtf(model.data[0] * model.data[0] + model.data[1] * model.data[1]);
+    float view_scale = sqrtf(view.data[0] * view.data[0] + view.data[1] * view.data[1]);
+    float tile_pixels = tileset_get_tile_dims(map->set).x * model_scale * view_scale * viewport[2] * 0.5f;
+    if(tile_pixels >= map->lod->threshold) {
+        return false;
+    }
+
+    lod_update(map, s);
+    lod_draw_cached(map, s, model, view);
+
+    return true;
+}
+
+// Frees the level-of-detail data of map, if any
+void tilemap_lod_free(tilemap map) {
+    if(!map->lod) {
+        return;
+    }
+
+    tilemap_lod_invalidate(map);
+    glDeleteBuffers(2, map->lod->buffers);
+    sfree(map->lod);
+    map->lod = NULL;
+}
@@ -0,0 +1,223 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tilemap_region.h"
+
+#include "core/check.h"
+
+#include "tilemap.priv.h"
+
+#define VISITED(bits, index) ((bits)[(index) >> 6] & ((uint64)1 << ((index) & 63)))
+#define SET_VISITED(bits, index) ((bits)[(index) >> 6] |= ((uint64)1 << ((index) & 63)))
+
+// Heap-allocated work stack of tile indices, so that large regions can't overflow the call stack
+typedef struct region_stack {
+    uint32* data;
+    uint32 length;
+    uint32 capacity;
+} region_stack;
+
+static void region_push(region_stack* stack, uint32 index) {
+    if(stack->length == stack->capacity) {
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 256;
+        stack->data = srealloc(stack->data, stack->capacity * sizeof(uint32));
+    }
+
+    stack->data[stack->length++] = index;
+}
+
+// Returns the value that decides whether two tiles belong to the same region
+static inline uint16 region_key(tile t, tile_match match, uint8 mask_bits) {
+    return match == TILE_MATCH_ID ? t.id : (t.mask & mask_bits);
+}
+
+// Returns the root of label's set, halving the path to it along the way
+static uint32 label_find(uint32* parent, uint32 label) {
+    while(parent[label] != label) {
+        parent[label] = parent[parent[label]];
+        label = parent[label];
+    }
+
+    return label;
+}
+
+// Merges the sets of a and b. The smaller root wins, so that roots stay in row-major order.
+static uint32 label_union(uint32* parent, uint32 a, uint32 b) {
+    a = label_find(parent, a);
+    b = label_find(parent, b);
+    if(a < b) {
+        parent[b] = a;
+        return a;
+    }
+
+    parent[a] = b;
+    return b;
+}
+
+/** @brief Replaces the 4-connected region of matching tiles around [x, y] with id
+ *
+ * @param map The map to fill
+ * @param x The x coordinate to start from
+ * @param y The y coordinate to start from
+ * @param id The tile id to fill with
+ * @param match How to compare tiles against the one at [x, y]
+ * @param mask_bits The mask bits to compare when match is TILE_MATCH_MASK
+ * @return The number of tiles in the filled region
+ */
+uint32 tilemap_flood_fill(tilemap map, uint16 x, uint16 y, uint16 id, tile_match match, uint8 mask_bits) {
+    check_return(x < map->width && y < map->height, "Can't flood fill from out-of-bounds tile at [%d, %d] in a %dx%d map", 0, x, y, map->width, map->height);
+    check_return(id == NO_TILE || id < map->set.width * map->set.height, "Can't fill with tile id %d, active tileset has %d entries", 0, id, map->set.width * map->set.height);
+
+    uint32 width = map->width;
+    uint32 height = map->height;
+    uint16 key = region_key(map->tile_data[y * width + x], match, mask_bits);
+    tile value = (tile){ .id = id, .mask = id == NO_TILE ? 0 : tileset_get_mask(map->set, id) };
+
+    // Filled tiles may still match (e.g. when only comparing masks), so track which ones have been done
+    uint64* visited = mscalloc((width * height + 63) / 64, uint64);
+    region_stack stack = {0};
+    region_push(&stack, y * width + x);
+
+    uint32 filled = 0;
+    while(stack.length > 0) {
+        uint32 index = stack.data[--stack.length];
+        if(VISITED(visited, index)) {
+            continue;
+        }
+
+        uint32 row_start = index - index % width;
+        const tile* row = map->tile_data + row_start;
+        uint32 left = index - row_start;
+        uint32 right = left;
+        while(left > 0 && !VISITED(visited, row_start + left - 1) && region_key(row[left - 1], match, mask_bits) == key) {
+            --left;
+        }
+        while(right + 1 < width && !VISITED(visited, row_start + right + 1) && region_key(row[right + 1], match, mask_bits) == key) {
+            ++right;
+        }
+
+        tilemap_snapshot_preserve(map, row_start + left, right - left + 1);
+        tilemap_write_span(map, row_start + left, right - left + 1, value);
+        for(uint32 i = row_start + left; i <= row_start + right; ++i) {
+            SET_VISITED(visited, i);
+        }
+        filled += right - left + 1;
+
+        // Queue the start of each matching run in the rows above and below the span
+        uint32 row_index = row_start / width;
+        for(int8 d = -1; d <= 1; d += 2) {
+            if((d < 0 && row_index == 0) || (d > 0 && row_index + 1 >= height)) {
+                continue;
+            }
+
+            uint32 next_start = row_start + d * (int32)width;
+            const tile* next = map->tile_data + next_start;
+            bool in_run = false;
+            for(uint32 i = left; i <= right; ++i) {
+                bool matches = !VISITED(visited, next_start + i) && region_key(next[i], match, mask_bits) == key;
+                if(matches && !in_run) {
+                    region_push(&stack, next_start + i);
+                }
+                in_run = matches;
+            }
+        }
+    }
+
+    if(stack.data) {
+        sfree(stack.data);
+    }
+    sfree(visited);
+
+    return filled;
+}
+
+/** @brief Labels the 4-connected regions of matching tiles in map
+ *
+ * @param map The map to label
+ * @param match How to compare neighbouring tiles
+ * @param mask_bits The mask bits to compare when match is TILE_MATCH_MASK
+ * @return The labels, which must be cleaned up with tile_labels_cleanup
+ */
+tile_labels tilemap_label_regions(tilemap map, tile_match match, uint8 mask_bits) {
+    uint32 width = map->width;
+    uint32 height = map->height;
+
+    tile_labels result = { .width = width, .height = height };
+    result.labels = mscalloc(width * height, uint32);
+
+    // First pass: give each tile a provisional label from its left or upper neighbour, recording which labels meet.
+    // Label 0 is unused, so that it can mean "no matching neighbour".
+    uint32 parent_capacity = width + 2;
+    uint32* parent = mscalloc(parent_capacity, uint32);
+    uint32 parent_count = 1;
+    for(uint32 i = 0; i < height; ++i) {
+        const tile* row = map->tile_data + i * width;
+        uint32* labels = result.labels + i * width;
+
+        for(uint32 j = 0; j < width; ++j) {
+            uint16 key = region_key(row[j], match, mask_bits);
+            uint32 left = (j > 0 && region_key(row[j - 1], match, mask_bits) == key) ? labels[j - 1] : 0;
+            uint32 up = (i > 0 && region_key(map->tile_data[(i - 1) * width + j], match, mask_bits) == key) ? result.labels[(i - 1) * width + j] : 0;
+
+            if(left && up) {
+                labels[j] = left != up ? label_union(parent, left, up) : left;
+            } else if(left || up) {
+                labels[j] = left | up;
+            } else {
+                if(parent_count == parent_capacity) {
+                    parent_capacity *= 2;
+                    parent = srealloc(parent, parent_capacity * sizeof(uint32));
+                }
+                parent[parent_count] = parent_count;
+                labels[j] = parent_count++;
+            }
+        }
+    }
+
+    // Number the final regions in order of their first tile
+    uint32* compact = mscalloc(parent_count, uint32);
+    for(uint32 i = 1; i < parent_count; ++i) {
+        uint32 root = label_find(parent, i);
+        compact[i] = root == i ? result.region_count++ : compact[root];
+    }
+
+    // Second pass: resolve labels and gather region statistics
+    result.regions = mscalloc(result.region_count, tile_region);
+    for(uint32 i = 0; i < height; ++i) {
+        for(uint32 j = 0; j < width; ++j) {
+            uint32 label = compact[result.labels[i * width + j]];
+            result.labels[i * width + j] = label;
+
+            tile_region* region = &result.regions[label];
+            if(region->size == 0) {
+                *region = (tile_region){ .min_x = j, .min_y = i, .max_x = j, .max_y = i, .sample = map->tile_data[i * width + j] };
+            } else {
+                if(j < region->min_x) {
+                    region->min_x = j;
+                } else if(j > region->max_x) {
+                    region->max_x = j;
+                }
+                region->max_y = i;
+            }
+            ++region->size;
+        }
+    }
+
+    sfree(compact);
+    sfree(parent);
+
+    return result;
+}
+
+// Frees up the dynamic contents of a set of labels
+void tile_labels_cleanup(tile_labels* labels) {
+    check_return(labels, "Can't cleanup labels, because they're NULL", );
+
+    if(labels->labels) {
+        sfree(labels->labels);
+    }
+    if(labels->regions) {
+        sfree(labels->regions);
+    }
+    labels->region_count = 0;
+}
@@ -0,0 +1,64 @@
+#ifndef DF_TILES_TILEMAP_REGION
+#define DF_TILES_TILEMAP_REGION
+#include "tilemap.h"
+
+// Decides when two neighbouring tiles belong to the same region
+typedef enum tile_match {
+    // Tiles match if they have the same id
+    TILE_MATCH_ID,
+
+    // Tiles match if they have the same value for the selected mask bits
+    TILE_MATCH_MASK
+} tile_match;
+
+// Statistics for a single connected region
+typedef struct tile_region {
+    uint16 min_x;
+    uint16 min_y;
+    uint16 max_x;
+    uint16 max_y;
+
+    // Number of tiles in the region
+    uint32 size;
+
+    // The first tile of the region, in row-major order
+    tile sample;
+} tile_region;
+
+// The result of labelling a map's connected regions
+typedef struct tile_labels {
+    uint16 width;
+    uint16 height;
+
+    // The region index of each tile, in row-major order
+    uint32* labels;
+
+    tile_region* regions;
+    uint32 region_count;
+} tile_labels;
+
+/** @brief Replaces the 4-connected region of matching tiles around [x, y] with id
+ *
+ * @param map The map to fill
+ * @param x The x coordinate to start from
+ * @param y The y coordinate to start from
+ * @param id The tile id to fill with
+ * @param match How to compare tiles against the one at [x, y]
+ * @param mask_bits The mask bits to compare when match is TILE_MATCH_MASK
+ * @return The number of tiles in the filled region
+ */
+uint32 tilemap_flood_fill(tilemap map, uint16 x, uint16 y, uint16 id, tile_match match, uint8 mask_bits);
+
+/** @brief Labels the 4-connected regions of matching tiles in map
+ *
+ * @param map The map to label
+ * @param match How to compare neighbouring tiles
+ * @param mask_bits The mask bits to compare when match is TILE_MATCH_MASK
+ * @return The labels, which must be cleaned up with tile_labels_cleanup
+ */
+tile_labels tilemap_label_regions(tilemap map, tile_match match, uint8 mask_bits);
+
+// Frees up the dynamic contents of a set of labels
+void tile_labels_cleanup(tile_labels* labels);
+
+#endif
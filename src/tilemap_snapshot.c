@@ -0,0 +1,227 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tilemap.h"
+
+#include "core/check.h"
+#include "core/stringutil.h"
+
+#include <string.h>
+
+#include "tilemap.priv.h"
+
+// Returns the number of tiles in page, accounting for the last page being partial
+static uint32 snapshot_page_length(uint32 width, uint32 height, uint32 page) {
+    uint32 remaining = width * height - page * TILEMAP_PAGE_TILES;
+    return remaining < TILEMAP_PAGE_TILES ? remaining : TILEMAP_PAGE_TILES;
+}
+
+// Frees the page copies and other contents of snapshot, leaving just the struct and its lock
+static void snapshot_release_contents(tilemap_snapshot snapshot) {
+    for(uint32 i = 0; i < snapshot->page_count; ++i) {
+        if(snapshot->pages[i]) {
+            sfree(snapshot->pages[i]);
+        }
+    }
+    if(snapshot->pages) {
+        sfree(snapshot->pages);
+        snapshot->pages = NULL;
+    }
+    snapshot->page_count = 0;
+    if(snapshot->tileset_path) {
+        sfree(snapshot->tileset_path);
+        snapshot->tileset_path = NULL;
+    }
+}
+
+static void snapshot_destroy(tilemap_snapshot snapshot) {
+    snapshot_release_contents(snapshot);
+    pthread_mutex_destroy(&snapshot->lock);
+    sfree(snapshot);
+}
+
+// Gives snapshot its own copy of page, unless it has one already. The snapshot must be locked.
+static void snapshot_copy_page(tilemap_snapshot snapshot, tilemap map, uint32 page) {
+    if(snapshot->pages[page]) {
+        return;
+    }
+
+    uint32 length = snapshot_page_length(map->width, map->height, page);
+    snapshot->pages[page] = mscalloc(length, tile);
+    memcpy(snapshot->pages[page], map->tile_data + page * TILEMAP_PAGE_TILES, length * sizeof(tile));
+}
+
+// Drops snapshot from map's list, without freeing it
+static void snapshot_unlink(tilemap map, uint8 index) {
+    map->snapshots[index] = map->snapshots[--map->snapshot_count];
+
+    if(map->snapshot_count == 0) {
+        sfree(map->snapshots);
+        map->snapshots = NULL;
+        sfree(map->page_shared);
+        map->page_shared = NULL;
+    }
+}
+
+// Destroys any snapshots of map that were freed while still attached to it
+static void snapshot_collect(tilemap map) {
+    for(uint8 i = 0; i < map->snapshot_count;) {
+        tilemap_snapshot snapshot = map->snapshots[i];
+
+        pthread_mutex_lock(&snapshot->lock);
+        bool released = snapshot->released;
+        pthread_mutex_unlock(&snapshot->lock);
+
+        if(released) {
+            snapshot_destroy(snapshot);
+            snapshot_unlink(map, i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Takes an immutable snapshot of map's tiles. Pages are shared with map until it modifies them, so this doesn't copy the grid.
+// The snapshot can be read and freed from any thread, while map keeps being edited on its own thread.
+tilemap_snapshot tilemap_snapshot_new(tilemap map) {
+    snapshot_collect(map);
+    check_return(map->snapshot_count < UINT8_MAX, "Too many live snapshots of tilemap (%d)", NULL, map->snapshot_count);
+
+    tilemap_snapshot snapshot = mscalloc(1, struct tilemap_snapshot);
+    pthread_mutex_init(&snapshot->lock, NULL);
+    snapshot->map = map;
+    snapshot->width = map->width;
+    snapshot->height = map->height;
+    snapshot->tileset_path = map->set.asset_path ? nstrdup(map->set.asset_path) : NULL;
+    snapshot->page_count = (map->width * map->height + TILEMAP_PAGE_TILES - 1) / TILEMAP_PAGE_TILES;
+    snapshot->pages = mscalloc(snapshot->page_count, tile*);
+
+    if(!map->page_shared) {
+        map->page_shared = mscalloc(snapshot->page_count, bool);
+    }
+    memset(map->page_shared, true, snapshot->page_count * sizeof(bool));
+
+    map->snapshots = srealloc(map->snapshots, (map->snapshot_count + 1) * sizeof(tilemap_snapshot));
+    map->snapshots[map->snapshot_count++] = snapshot;
+
+    return snapshot;
+}
+
+// Frees a snapshot. This is safe to call from any thread.
+void _tilemap_snapshot_free(tilemap_snapshot snapshot) {
+    pthread_mutex_lock(&snapshot->lock);
+    bool attached = snapshot->map != NULL;
+    snapshot->released = true;
+
+    // The map never touches the pages of a released snapshot, so they can go now rather than waiting for the map to be touched again
+    if(attached) {
+        snapshot_release_contents(snapshot);
+    }
+    pthread_mutex_unlock(&snapshot->lock);
+
+    // Attached snapshots are unlinked and destroyed by their map, which is the only thread that may touch its list
+    if(!attached) {
+        snapshot_destroy(snapshot);
+    }
+}
+
+// Copies count tiles, starting at row-major index start, out of the snapshot
+void tilemap_snapshot_read(tilemap_snapshot snapshot, uint32 start, uint32 count, tile* out) {
+    check_return(start + count <= snapshot->width * snapshot->height, "Can't read tiles [%d, %d) from a %dx%d snapshot", , start, start + count, snapshot->width, snapshot->height);
+
+    while(count > 0) {
+        uint32 page = start / TILEMAP_PAGE_TILES;
+        uint32 offset = start % TILEMAP_PAGE_TILES;
+        uint32 length = TILEMAP_PAGE_TILES - offset < count ? TILEMAP_PAGE_TILES - offset : count;
+
+        // The map copies a page into the snapshot under this lock before modifying it, so a shared page can't change mid-read
+        pthread_mutex_lock(&snapshot->lock);
+        const tile* src = snapshot->pages[page] ? snapshot->pages[page] + offset : snapshot->map->tile_data + start;
+        memcpy(out, src, length * sizeof(tile));
+        pthread_mutex_unlock(&snapshot->lock);
+
+        start += length;
+        out += length;
+        count -= length;
+    }
+}
+
+// Returns the tile value at [x, y] when the snapshot was taken. Defaults to 0 and logs a warning if [x,y] is out-of-bounds.
+tile tilemap_snapshot_get_tile(tilemap_snapshot snapshot, uint16 x, uint16 y) {
+    check_return(x < snapshot->width && y < snapshot->height, "Can't get out-of-bounds tile at [%d, %d] from a %dx%d snapshot", (tile){0}, x, y, snapshot->width, snapshot->height);
+
+    tile result;
+    tilemap_snapshot_read(snapshot, y * snapshot->width + x, 1, &result);
+
+    return result;
+}
+
+// Returns the width of the snapshot
+uint16 tilemap_snapshot_get_width(tilemap_snapshot snapshot) {
+    return snapshot->width;
+}
+
+// Returns the height of the snapshot
+uint16 tilemap_snapshot_get_height(tilemap_snapshot snapshot) {
+    return snapshot->height;
+}
+
+// Returns the asset path of the map's tileset when the snapshot was taken, or NULL if it had none
+const char* tilemap_snapshot_get_tileset_path(tilemap_snapshot snapshot) {
+    return snapshot->tileset_path;
+}
+
+// Gives every snapshot of map its own copy of the pages covering count tiles from start. Must be called before modifying tile_data.
+void tilemap_snapshot_preserve(tilemap map, uint32 start, uint32 count) {
+    if(map->snapshot_count == 0 || count == 0) {
+        return;
+    }
+
+    uint32 last = (start + count - 1) / TILEMAP_PAGE_TILES;
+    for(uint32 page = start / TILEMAP_PAGE_TILES; page <= last && map->page_shared; ++page) {
+        if(!map->page_shared[page]) {
+            continue;
+        }
+        map->page_shared[page] = false;
+
+        for(uint8 i = 0; i < map->snapshot_count;) {
+            tilemap_snapshot snapshot = map->snapshots[i];
+
+            pthread_mutex_lock(&snapshot->lock);
+            bool released = snapshot->released;
+            if(!released) {
+                snapshot_copy_page(snapshot, map, page);
+            }
+            pthread_mutex_unlock(&snapshot->lock);
+
+            if(released) {
+                snapshot_destroy(snapshot);
+                snapshot_unlink(map, i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+// Copies all shared pages into map's snapshots and disconnects them, so that tile_data can be reallocated or freed
+void tilemap_snapshot_detach_all(tilemap map) {
+    while(map->snapshot_count > 0) {
+        tilemap_snapshot snapshot = map->snapshots[0];
+
+        pthread_mutex_lock(&snapshot->lock);
+        bool released = snapshot->released;
+        if(!released) {
+            for(uint32 i = 0; i < snapshot->page_count; ++i) {
+                snapshot_copy_page(snapshot, map, i);
+            }
+            snapshot->map = NULL;
+        }
+        pthread_mutex_unlock(&snapshot->lock);
+
+        if(released) {
+            snapshot_destroy(snapshot);
+        }
+        snapshot_unlink(map, 0);
+    }
+}
@@ -0,0 +1,537 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tilemap_visibility.h"
+
+#include "core/check.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tilemap_delta.h"
+#include "tilemap.priv.h"
+
+// Journal capacity used when the lightmap has to enable the map's journal itself
+#define LIGHTMAP_JOURNAL_CAPACITY 4096
+
+// Step costs for light propagation. Their ratio approximates sqrt(2), so that light spreads in rough circles.
+#define LIGHT_COST_STRAIGHT 2
+#define LIGHT_COST_DIAGONAL 3
+
+// Transforms from the first octant into each of the others, as [xx, xy, yx, yy]
+static const int8 fov_octants[8][4] = {
+    {  1,  0,  0,  1 }, {  0,  1,  1,  0 }, {  0, -1,  1,  0 }, { -1,  0,  0,  1 },
+    { -1,  0,  0, -1 }, {  0, -1, -1,  0 }, {  0,  1, -1,  0 }, {  1,  0,  0, -1 },
+};
+
+typedef struct fov_state {
+    const tile* tiles;
+    uint8* visible;
+    int32 width;
+    int32 height;
+    int32 x;
+    int32 y;
+    int32 radius;
+    uint8 opaque_bits;
+    uint32 revealed;
+} fov_state;
+
+// A rectangle of per-tile light levels, clipped to the map
+typedef struct light_window {
+    uint16 min_x;
+    uint16 min_y;
+    uint16 width;
+    uint16 height;
+    uint16* levels;
+} light_window;
+
+typedef struct tile_light {
+    uint16 x;
+    uint16 y;
+    uint16 radius;
+    uint16 intensity;
+
+    bool active;
+    bool dirty;
+
+    // The contribution currently added to the lightmap's levels
+    light_window applied;
+
+    // The result of the latest recompute, waiting to replace applied
+    light_window pending;
+} tile_light;
+
+typedef struct tile_lightmap {
+    tilemap map;
+    uint8 opaque_bits;
+
+    uint16 width;
+    uint16 height;
+
+    // Cached opacity of each tile, so that changes which don't affect light can be skipped
+    bool* opaque;
+    uint32* levels;
+    uint32 version;
+
+    tile_light* lights;
+    uint32 light_count;
+}* tile_lightmap;
+
+// Lights for a worker thread to recompute: every stride-th entry of lights, starting from first
+typedef struct light_job {
+    const struct tile_lightmap* lightmap;
+    tile_light** lights;
+    uint32 count;
+    uint32 first;
+    uint32 stride;
+} light_job;
+
+// Growable list of window indices waiting to be expanded, all at the same cost
+typedef struct light_bucket {
+    uint32* data;
+    uint32 length;
+    uint32 capacity;
+} light_bucket;
+
+static inline bool fov_blocks(const fov_state* state, int32 x, int32 y) {
+    return x < 0 || y < 0 || x >= state->width || y >= state->height || (state->tiles[y * state->width + x].mask & state->opaque_bits);
+}
+
+static inline void fov_reveal(fov_state* state, int32 x, int32 y) {
+    if(x < 0 || y < 0 || x >= state->width || y >= state->height) {
+        return;
+    }
+
+    uint8* entry = &state->visible[y * state->width + x];
+    if(!*entry) {
+        *entry = 1;
+        ++state->revealed;
+    }
+}
+
+// Scans one octant from row outwards, between the slopes start and end. Recurses for each gap past an opaque tile.
+static void fov_cast(fov_state* state, int32 row, float start, float end, const int8* octant) {
+    if(start < end) {
+        return;
+    }
+
+    int32 radius_squared = state->radius * (state->radius + 1);
+    float new_start = 0;
+    for(int32 i = row; i <= state->radius; ++i) {
+        bool blocked = false;
+        int32 dy = -i;
+        for(int32 dx = -i; dx <= 0; ++dx) {
+            float left_slope = (dx - 0.5f) / (dy + 0.5f);
+            float right_slope = (dx + 0.5f) / (dy - 0.5f);
+            if(start < right_slope) {
+                continue;
+            } else if(end > left_slope) {
+                break;
+            }
+
+            int32 x = state->x + dx * octant[0] + dy * octant[1];
+            int32 y = state->y + dx * octant[2] + dy * octant[3];
+            if(dx * dx + dy * dy <= radius_squared) {
+                fov_reveal(state, x, y);
+            }
+
+            bool opaque = fov_blocks(state, x, y);
+            if(blocked) {
+                if(opaque) {
+                    new_start = right_slope;
+                } else {
+                    blocked = false;
+                    start = new_start;
+                }
+            } else if(opaque && i < state->radius) {
+                blocked = true;
+                fov_cast(state, i + 1, start, left_slope, octant);
+                new_start = right_slope;
+            }
+        }
+
+        if(blocked) {
+            break;
+        }
+    }
+}
+
+/** @brief Marks the tiles visible from [x, y] using recursive shadowcasting
+ *
+ * Tiles with any of opaque_bits set in their mask block sight, but are visible themselves.
+ * Entries of visible for tiles that can't be seen are left untouched, so the same buffer can accumulate explored tiles.
+ *
+ * @param map The map to look through
+ * @param x The x coordinate of the viewer
+ * @param y The y coordinate of the viewer
+ * @param radius The maximum view distance, in tiles
+ * @param opaque_bits The mask bits that block sight
+ * @param visible A buffer with an entry for each tile in map, in row-major order. Visible tiles are set to 1.
+ * @return The number of entries in visible that changed from 0 to 1
+ */
+uint32 tilemap_fov(tilemap map, uint16 x, uint16 y, uint16 radius, uint8 opaque_bits, uint8* visible) {
+    check_return(visible, "Can't compute field of view without a visibility buffer", 0);
+    check_return(x < map->width && y < map->height, "Can't compute field of view from out-of-bounds tile at [%d, %d] in a %dx%d map", 0, x, y, map->width, map->height);
+
+    fov_state state = {
+        .tiles = map->tile_data,
+        .visible = visible,
+        .width = map->width,
+        .height = map->height,
+        .x = x,
+        .y = y,
+        .radius = radius,
+        .opaque_bits = opaque_bits,
+    };
+
+    fov_reveal(&state, x, y);
+    for(uint8 i = 0; i < 8; ++i) {
+        fov_cast(&state, 1, 1.0f, 0.0f, fov_octants[i]);
+    }
+
+    return state.revealed;
+}
+
+static void light_window_free(light_window* window) {
+    if(window->levels) {
+        sfree(window->levels);
+        window->levels = NULL;
+    }
+    window->width = 0;
+    window->height = 0;
+}
+
+static void light_bucket_push(light_bucket* bucket, uint32 index) {
+    if(bucket->length == bucket->capacity) {
+        bucket->capacity = bucket->capacity ? bucket->capacity * 2 : 64;
+        bucket->data = srealloc(bucket->data, bucket->capacity * sizeof(uint32));
+    }
+
+    bucket->data[bucket->length++] = index;
+}
+
+// Floods light outwards from its source into its pending window. Only reads the lightmap, so lights can be computed in parallel.
+static void light_compute(const struct tile_lightmap* lightmap, tile_light* light) {
+    light_window* window = &light->pending;
+    light_window_free(window);
+    if(light->x >= lightmap->width || light->y >= lightmap->height) {
+        return;
+    }
+
+    uint16 max_x = lightmap->width - light->x > light->radius ? light->x + light->radius : lightmap->width - 1;
+    uint16 max_y = lightmap->height - light->y > light->radius ? light->y + light->radius : lightmap->height - 1;
+    window->min_x = light->x > light->radius ? light->x - light->radius : 0;
+    window->min_y = light->y > light->radius ? light->y - light->radius : 0;
+    window->width = max_x - window->min_x + 1;
+    window->height = max_y - window->min_y + 1;
+    window->levels = mscalloc(window->width * window->height, uint16);
+
+    uint32 area = window->width * window->height;
+    uint16* cost = mscalloc(area, uint16);
+    memset(cost, 0xFF, area * sizeof(uint16));
+
+    // Dial's algorithm: step costs are at most 3, so four rotating buckets hold every queued tile
+    light_bucket buckets[4] = {0};
+    uint32 max_cost = light->radius * LIGHT_COST_STRAIGHT;
+    uint32 source = (light->y - window->min_y) * window->width + (light->x - window->min_x);
+    cost[source] = 0;
+    light_bucket_push(&buckets[0], source);
+    uint32 queued = 1;
+
+    for(uint32 current = 0; queued > 0; ++current) {
+        light_bucket* bucket = &buckets[current & 3];
+        for(uint32 i = 0; i < bucket->length; ++i) {
+            uint32 index = bucket->data[i];
+            if(cost[index] != current) {
+                continue;
+            }
+
+            window->levels[index] = (uint32)light->intensity * (max_cost + 1 - current) / (max_cost + 1);
+
+            int32 wx = index % window->width;
+            int32 wy = index / window->width;
+            if(lightmap->opaque[(window->min_y + wy) * lightmap->width + window->min_x + wx]) {
+                continue;
+            }
+
+            for(int8 dy = -1; dy <= 1; ++dy) {
+                for(int8 dx = -1; dx <= 1; ++dx) {
+                    int32 nx = wx + dx;
+                    int32 ny = wy + dy;
+                    if((dx == 0 && dy == 0) || nx < 0 || ny < 0 || nx >= window->width || ny >= window->height) {
+                        continue;
+                    }
+
+                    uint32 step = LIGHT_COST_STRAIGHT;
+                    if(dx != 0 && dy != 0) {
+                        // Light can't squeeze diagonally between two opaque tiles
+                        uint32 row = (window->min_y + wy) * lightmap->width + window->min_x;
+                        if(lightmap->opaque[row + nx] && lightmap->opaque[row + (int32)lightmap->width * dy + wx]) {
+                            continue;
+                        }
+                        step = LIGHT_COST_DIAGONAL;
+                    }
+
+                    uint32 next = ny * window->width + nx;
+                    uint32 next_cost = current + step;
+                    if(next_cost <= max_cost && next_cost < cost[next]) {
+                        cost[next] = next_cost;
+                        light_bucket_push(&buckets[next_cost & 3], next);
+                        ++queued;
+                    }
+                }
+            }
+        }
+
+        queued -= bucket->length;
+        bucket->length = 0;
+    }
+
+    for(uint8 i = 0; i < 4; ++i) {
+        if(buckets[i].data) {
+            sfree(buckets[i].data);
+        }
+    }
+    sfree(cost);
+}
+
+static void* light_worker(void* user) {
+    light_job* job = user;
+    for(uint32 i = job->first; i < job->count; i += job->stride) {
+        light_compute(job->lightmap, job->lights[i]);
+    }
+
+    return NULL;
+}
+
+// Adds (or with sign -1, removes) a window's levels to the lightmap's totals
+static void lightmap_apply(tile_lightmap lightmap, const light_window* window, int8 sign) {
+    for(uint16 i = 0; i < window->height; ++i) {
+        uint32* row = lightmap->levels + (window->min_y + i) * lightmap->width + window->min_x;
+        const uint16* levels = window->levels + i * window->width;
+        for(uint16 j = 0; j < window->width; ++j) {
+            row[j] += sign * (int32)levels[j];
+        }
+    }
+}
+
+// Re-reads the opacity of every tile. Returns true if the map's size changed, in which case every light must be recomputed.
+static bool lightmap_sync_all(tile_lightmap lightmap) {
+    tilemap map = lightmap->map;
+    bool resized = map->width != lightmap->width || map->height != lightmap->height;
+    uint32 area = map->width * map->height;
+
+    if(resized) {
+        lightmap->width = map->width;
+        lightmap->height = map->height;
+        lightmap->opaque = srealloc(lightmap->opaque, area * sizeof(bool));
+        lightmap->levels = srealloc(lightmap->levels, area * sizeof(uint32));
+        memset(lightmap->levels, 0, area * sizeof(uint32));
+
+        // The old windows refer to the old layout, so there's nothing to subtract them from
+        for(uint32 i = 0; i < lightmap->light_count; ++i) {
+            light_window_free(&lightmap->lights[i].applied);
+        }
+    }
+
+    for(uint32 i = 0; i < area; ++i) {
+        lightmap->opaque[i] = (map->tile_data[i].mask & lightmap->opaque_bits) != 0;
+    }
+
+    return resized;
+}
+
+// Marks every light whose radius covers [x, y] as needing a recompute
+static void lightmap_mark_lights(tile_lightmap lightmap, uint16 x, uint16 y) {
+    for(uint32 i = 0; i < lightmap->light_count; ++i) {
+        tile_light* light = &lightmap->lights[i];
+        if(light->active && abs(x - light->x) <= light->radius && abs(y - light->y) <= light->radius) {
+            light->dirty = true;
+        }
+    }
+}
+
+// Creates an empty lightmap for map. This enables map's journal if it doesn't have one, to find which tiles have changed between updates.
+tile_lightmap tile_lightmap_new(tilemap map, uint8 opaque_bits) {
+    check_return(map, "Can't create a lightmap without a map", NULL);
+    check_return(opaque_bits != 0, "Can't create a lightmap without any opacity bits", NULL);
+
+    if(!map->journal) {
+        tilemap_journal_enable(map, LIGHTMAP_JOURNAL_CAPACITY);
+    }
+
+    tile_lightmap lightmap = mscalloc(1, struct tile_lightmap);
+    lightmap->map = map;
+    lightmap->opaque_bits = opaque_bits;
+    lightmap_sync_all(lightmap);
+    lightmap->version = tilemap_get_version(map);
+
+    return lightmap;
+}
+
+// Frees a lightmap. The map's journal is left enabled.
+void _tile_lightmap_free(tile_lightmap lightmap) {
+    for(uint32 i = 0; i < lightmap->light_count; ++i) {
+        light_window_free(&lightmap->lights[i].applied);
+        light_window_free(&lightmap->lights[i].pending);
+    }
+
+    if(lightmap->lights) {
+        sfree(lightmap->lights);
+    }
+    if(lightmap->opaque) {
+        sfree(lightmap->opaque);
+    }
+    if(lightmap->levels) {
+        sfree(lightmap->levels);
+    }
+    sfree(lightmap);
+}
+
+// Adds a light at [x, y] that reaches radius tiles, fading out from intensity at its center. Returns the new light's handle, or NO_LIGHT if an error occurs.
+uint32 tile_lightmap_add_light(tile_lightmap lightmap, uint16 x, uint16 y, uint16 radius, uint16 intensity) {
+    check_return(radius < UINT16_MAX / LIGHT_COST_DIAGONAL, "Light radius %d is too large", NO_LIGHT, radius);
+
+    uint32 index = 0;
+    while(index < lightmap->light_count && lightmap->lights[index].active) {
+        ++index;
+    }
+    if(index == lightmap->light_count) {
+        lightmap->lights = srealloc(lightmap->lights, (lightmap->light_count + 1) * sizeof(tile_light));
+        ++lightmap->light_count;
+    }
+
+    lightmap->lights[index] = (tile_light){ .x = x, .y = y, .radius = radius, .intensity = intensity, .active = true, .dirty = true };
+
+    return index;
+}
+
+// Moves a light to [x, y]
+void tile_lightmap_move_light(tile_lightmap lightmap, uint32 light, uint16 x, uint16 y) {
+    check_return(light < lightmap->light_count && lightmap->lights[light].active, "Can't move nonexistent light %u", , light);
+
+    tile_light* l = &lightmap->lights[light];
+    if(l->x != x || l->y != y) {
+        l->x = x;
+        l->y = y;
+        l->dirty = true;
+    }
+}
+
+// Removes a light, and takes its contribution out of the lightmap immediately
+void tile_lightmap_remove_light(tile_lightmap lightmap, uint32 light) {
+    check_return(light < lightmap->light_count && lightmap->lights[light].active, "Can't remove nonexistent light %u", , light);
+
+    tile_light* l = &lightmap->lights[light];
+    lightmap_apply(lightmap, &l->applied, -1);
+    light_window_free(&l->applied);
+    light_window_free(&l->pending);
+    l->active = false;
+    l->dirty = false;
+}
+
+/** @brief Brings the lightmap up to date with its map and lights
+ *
+ * Only lights that were added or moved, or whose radius covers a tile whose opacity changed since the last update, are recomputed.
+ *
+ * @param lightmap The lightmap to update
+ * @param threads The maximum number of threads to recompute lights on. 0 or 1 recomputes them on the calling thread.
+ * @return The number of lights that were recomputed
+ */
+uint32 tile_lightmap_update(tile_lightmap lightmap, uint8 threads) {
+    tilemap map = lightmap->map;
+
+    uint32* indices = NULL;
+    uint32 count = tilemap_journal_collect(map, lightmap->version, &indices);
+    lightmap->version = tilemap_get_version(map);
+    if(count == UINT32_MAX) {
+        // The journal doesn't reach back far enough (or the map was resized), so start over
+        lightmap_sync_all(lightmap);
+        for(uint32 i = 0; i < lightmap->light_count; ++i) {
+            lightmap->lights[i].dirty = lightmap->lights[i].active;
+        }
+    } else {
+        for(uint32 i = 0; i < count; ++i) {
+            bool opaque = (map->tile_data[indices[i]].mask & lightmap->opaque_bits) != 0;
+            if(opaque != lightmap->opaque[indices[i]]) {
+                lightmap->opaque[indices[i]] = opaque;
+                lightmap_mark_lights(lightmap, indices[i] % lightmap->width, indices[i] / lightmap->width);
+            }
+        }
+    }
+    if(indices) {
+        sfree(indices);
+    }
+
+    uint32 dirty_count = 0;
+    for(uint32 i = 0; i < lightmap->light_count; ++i) {
+        dirty_count += lightmap->lights[i].dirty;
+    }
+    if(dirty_count == 0) {
+        return 0;
+    }
+
+    tile_light** dirty = mscalloc(dirty_count, tile_light*);
+    for(uint32 i = 0, j = 0; i < lightmap->light_count; ++i) {
+        if(lightmap->lights[i].dirty) {
+            dirty[j++] = &lightmap->lights[i];
+        }
+    }
+
+    uint32 thread_count = threads < dirty_count ? threads : dirty_count;
+    if(thread_count <= 1) {
+        light_job job = { .lightmap = lightmap, .lights = dirty, .count = dirty_count, .first = 0, .stride = 1 };
+        light_worker(&job);
+    } else {
+        // The calling thread takes the first share of the work itself
+        pthread_t* workers = mscalloc(thread_count, pthread_t);
+        bool* started = mscalloc(thread_count, bool);
+        light_job* jobs = mscalloc(thread_count, light_job);
+        for(uint32 i = 0; i < thread_count; ++i) {
+            jobs[i] = (light_job){ .lightmap = lightmap, .lights = dirty, .count = dirty_count, .first = i, .stride = thread_count };
+        }
+        for(uint32 i = 1; i < thread_count; ++i) {
+            started[i] = pthread_create(&workers[i], NULL, light_worker, &jobs[i]) == 0;
+        }
+        light_worker(&jobs[0]);
+        for(uint32 i = 1; i < thread_count; ++i) {
+            if(started[i]) {
+                pthread_join(workers[i], NULL);
+            } else {
+                warn("Can't start light worker thread, recomputing its lights on the calling thread");
+                light_worker(&jobs[i]);
+            }
+        }
+
+        sfree(jobs);
+        sfree(started);
+        sfree(workers);
+    }
+
+    // Swap each light's new contribution in for its old one
+    for(uint32 i = 0; i < dirty_count; ++i) {
+        tile_light* light = dirty[i];
+        lightmap_apply(lightmap, &light->applied, -1);
+        lightmap_apply(lightmap, &light->pending, 1);
+        light_window_free(&light->applied);
+        light->applied = light->pending;
+        light->pending = (light_window){0};
+        light->dirty = false;
+    }
+    sfree(dirty);
+
+    return dirty_count;
+}
+
+// Returns the light level at [x, y], as of the last update. Defaults to 0 and logs a warning if [x,y] is out-of-bounds.
+uint32 tile_lightmap_get_level(tile_lightmap lightmap, uint16 x, uint16 y) {
+    check_return(x < lightmap->width && y < lightmap->height, "Can't get out-of-bounds light level at [%d, %d] from a %dx%d lightmap", 0, x, y, lightmap->width, lightmap->height);
+
+    return lightmap->levels[y * lightmap->width + x];
+}
+
+// Returns the light level of every tile, in row-major order, as of the last update
+const uint32* tile_lightmap_get_data(tile_lightmap lightmap) {
+    return lightmap->levels;
+}
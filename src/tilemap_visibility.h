@@ -0,0 +1,59 @@
+#ifndef DF_TILES_TILEMAP_VISIBILITY
+#define DF_TILES_TILEMAP_VISIBILITY
+#include "tilemap.h"
+
+// Returned by tile_lightmap_add_light when the light can't be added
+#define NO_LIGHT UINT32_MAX
+
+// Light levels for every tile of a map, cached per light so that only lights near changed tiles are recomputed.
+// Tiles with any of the opacity bits set in their mask stop light, but are lit themselves.
+declarep(struct, tile_lightmap)
+
+/** @brief Marks the tiles visible from [x, y] using recursive shadowcasting
+ *
+ * Tiles with any of opaque_bits set in their mask block sight, but are visible themselves.
+ * Entries of visible for tiles that can't be seen are left untouched, so the same buffer can accumulate explored tiles.
+ *
+ * @param map The map to look through
+ * @param x The x coordinate of the viewer
+ * @param y The y coordinate of the viewer
+ * @param radius The maximum view distance, in tiles
+ * @param opaque_bits The mask bits that block sight
+ * @param visible A buffer with an entry for each tile in map, in row-major order. Visible tiles are set to 1.
+ * @return The number of entries in visible that changed from 0 to 1
+ */
+uint32 tilemap_fov(tilemap map, uint16 x, uint16 y, uint16 radius, uint8 opaque_bits, uint8* visible);
+
+// Creates an empty lightmap for map. This enables map's journal if it doesn't have one, to find which tiles have changed between updates.
+tile_lightmap tile_lightmap_new(tilemap map, uint8 opaque_bits);
+
+// Frees a lightmap. The map's journal is left enabled.
+#define tile_lightmap_free(lightmap) { _tile_lightmap_free(lightmap); lightmap = NULL; }
+void _tile_lightmap_free(tile_lightmap lightmap);
+
+// Adds a light at [x, y] that reaches radius tiles, fading out from intensity at its center. Returns the new light's handle, or NO_LIGHT if an error occurs.
+uint32 tile_lightmap_add_light(tile_lightmap lightmap, uint16 x, uint16 y, uint16 radius, uint16 intensity);
+
+// Moves a light to [x, y]
+void tile_lightmap_move_light(tile_lightmap lightmap, uint32 light, uint16 x, uint16 y);
+
+// Removes a light, and takes its contribution out of the lightmap immediately
+void tile_lightmap_remove_light(tile_lightmap lightmap, uint32 light);
+
+/** @brief Brings the lightmap up to date with its map and lights
+ *
+ * Only lights that were added or moved, or whose radius covers a tile whose opacity changed since the last update, are recomputed.
+ *
+ * @param lightmap The lightmap to update
+ * @param threads The maximum number of threads to recompute lights on. 0 or 1 recomputes them on the calling thread.
+ * @return The number of lights that were recomputed
+ */
+uint32 tile_lightmap_update(tile_lightmap lightmap, uint8 threads);
+
+// Returns the light level at [x, y], as of the last update. Defaults to 0 and logs a warning if [x,y] is out-of-bounds.
+uint32 tile_lightmap_get_level(tile_lightmap lightmap, uint16 x, uint16 y);
+
+// Returns the light level of every tile, in row-major order, as of the last update
+const uint32* tile_lightmap_get_data(tile_lightmap lightmap);
+
+#endif
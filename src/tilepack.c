@@ -0,0 +1,499 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tilepack.h"
+#include "tilemap_io.h"
+#include "tileset_io.h"
+
+#include "core/check.h"
+#include "core/stringutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TILEPACK_MAGIC "DFTP"
+#define TILEPACK_VERSION 1
+#define TILEPACK_DEFAULT_CAPACITY 64
+
+// Unused space is only reclaimed automatically once there's at least this much of it
+#define TILEPACK_COMPACT_THRESHOLD (1 << 20)
+
+#define TILEPACK_ENTRY_USED 1
+#define TILEPACK_ENTRY_COORD 2
+
+typedef struct tilepack_header {
+    char magic[4];
+    uint32 version;
+    uint32 capacity;
+    uint32 count;
+} tilepack_header;
+
+// Index record, stored as-is at the front of the file
+typedef struct tilepack_entry {
+    char name[TILEPACK_NAME_LENGTH];
+    int32 x;
+    int32 y;
+    uint64 offset;
+    uint64 size;
+    uint8 flags;
+    uint8 reserved[7];
+} tilepack_entry;
+
+// A tileset that's shared by every map that references it
+typedef struct pack_tileset {
+    char* path;
+    tileset set;
+} pack_tileset;
+
+typedef struct tilepack {
+    char* path;
+    FILE* file;
+
+    tilepack_header header;
+    tilepack_entry* entries;
+
+    // Open-addressed table of entry indices + 1, so that 0 marks an empty slot
+    uint32* lookup;
+    uint32 lookup_capacity;
+
+    uint64 data_end;
+    uint64 live;
+
+    pack_tileset* tilesets;
+    uint16 tileset_count;
+}* tilepack;
+
+static uint64 pack_data_start(uint32 capacity) {
+    return sizeof(tilepack_header) + (uint64)capacity * sizeof(tilepack_entry);
+}
+
+static uint32 pack_hash(const char* name, int32 x, int32 y) {
+    if(!name) {
+        return ((uint32)x * 73856093u) ^ ((uint32)y * 19349663u);
+    }
+
+    // FNV-1a
+    uint32 hash = 2166136261u;
+    for(const char* c = name; *c; ++c) {
+        hash = (hash ^ (uint8)*c) * 16777619u;
+    }
+
+    return hash;
+}
+
+static bool pack_entry_matches(const tilepack_entry* entry, const char* name, int32 x, int32 y) {
+    if(!(entry->flags & TILEPACK_ENTRY_USED)) {
+        return false;
+    }
+
+    if(name) {
+        return !(entry->flags & TILEPACK_ENTRY_COORD) && !strncmp(entry->name, name, TILEPACK_NAME_LENGTH);
+    }
+
+    return (entry->flags & TILEPACK_ENTRY_COORD) && entry->x == x && entry->y == y;
+}
+
+static uint32 pack_entry_hash(const tilepack_entry* entry) {
+    return (entry->flags & TILEPACK_ENTRY_COORD) ? pack_hash(NULL, entry->x, entry->y) : pack_hash(entry->name, 0, 0);
+}
+
+static void pack_lookup_insert(tilepack pack, uint32 index) {
+    uint32 mask = pack->lookup_capacity - 1;
+    uint32 i = pack_entry_hash(&pack->entries[index]) & mask;
+    while(pack->lookup[i] != 0) {
+        i = (i + 1) & mask;
+    }
+
+    pack->lookup[i] = index + 1;
+}
+
+// Removes the entry at index from the lookup table, shifting back any slots that probed past it. Must be called before the entry is cleared.
+static void pack_lookup_remove(tilepack pack, uint32 index) {
+    uint32 mask = pack->lookup_capacity - 1;
+    uint32 i = pack_entry_hash(&pack->entries[index]) & mask;
+    while(pack->lookup[i] != index + 1) {
+        i = (i + 1) & mask;
+    }
+    pack->lookup[i] = 0;
+
+    for(uint32 j = (i + 1) & mask; pack->lookup[j] != 0; j = (j + 1) & mask) {
+        uint32 home = pack_entry_hash(&pack->entries[pack->lookup[j] - 1]) & mask;
+
+        // Slots can only move back if their home slot isn't cyclically between the hole and themselves
+        bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if(movable) {
+            pack->lookup[i] = pack->lookup[j];
+            pack->lookup[j] = 0;
+            i = j;
+        }
+    }
+}
+
+// Rebuilds the lookup table from the index
+static void pack_lookup_rebuild(tilepack pack) {
+    if(pack->lookup) {
+        sfree(pack->lookup);
+    }
+
+    pack->lookup_capacity = 16;
+    while(pack->lookup_capacity < pack->header.capacity * 2) {
+        pack->lookup_capacity *= 2;
+    }
+    pack->lookup = mscalloc(pack->lookup_capacity, uint32);
+
+    for(uint32 i = 0; i < pack->header.capacity; ++i) {
+        if(pack->entries[i].flags & TILEPACK_ENTRY_USED) {
+            pack_lookup_insert(pack, i);
+        }
+    }
+}
+
+// Returns the index of the entry with the given key, or -1 if there isn't one
+static int64 pack_find(tilepack pack, const char* name, int32 x, int32 y) {
+    uint32 mask = pack->lookup_capacity - 1;
+    for(uint32 i = pack_hash(name, x, y) & mask; pack->lookup[i] != 0; i = (i + 1) & mask) {
+        if(pack_entry_matches(&pack->entries[pack->lookup[i] - 1], name, x, y)) {
+            return pack->lookup[i] - 1;
+        }
+    }
+
+    return -1;
+}
+
+// Writes the header and a single index record back to the file
+static bool pack_write_entry(tilepack pack, uint32 index) {
+    size_t written = 0;
+    if(fseek(pack->file, 0, SEEK_SET) == 0) {
+        written += fwrite(&pack->header, sizeof(tilepack_header), 1, pack->file);
+    }
+    if(fseek(pack->file, sizeof(tilepack_header) + (uint64)index * sizeof(tilepack_entry), SEEK_SET) == 0) {
+        written += fwrite(&pack->entries[index], sizeof(tilepack_entry), 1, pack->file);
+    }
+
+    return !check_error(written == 2 && fflush(pack->file) == 0, "Failed to update the index of pack %s", pack->path);
+}
+
+// Provides tilesets for maps loaded from pack, so that maps referencing the same tileset share it
+static tileset pack_load_tileset(const char* path, void* user) {
+    tilepack pack = user;
+    for(uint16 i = 0; i < pack->tileset_count; ++i) {
+        if(!strcmp(pack->tilesets[i].path, path)) {
+            return pack->tilesets[i].set;
+        }
+    }
+
+    pack->tilesets = srealloc(pack->tilesets, (pack->tileset_count + 1) * sizeof(pack_tileset));
+    pack->tilesets[pack->tileset_count] = (pack_tileset){ .path = nstrdup(path), .set = load_tileset(path) };
+
+    return pack->tilesets[pack->tileset_count++].set;
+}
+
+// Rewrites the pack with room for capacity entries, and with every entry's data stored back-to-back
+static bool pack_rewrite(tilepack pack, uint32 capacity) {
+    size_t len = strlen(pack->path) + 5;
+    char* temp_path = mscalloc(len, char);
+    snprintf(temp_path, len, "%s.tmp", pack->path);
+
+    FILE* outfile = fopen(temp_path, "w+e");
+    if(check_error(outfile != NULL, "Failed to compact pack: Can't open file at %s", temp_path)) {
+        sfree(temp_path);
+        return false;
+    }
+
+    tilepack_entry* entries = mscalloc(capacity, tilepack_entry);
+    memcpy(entries, pack->entries, pack->header.capacity * sizeof(tilepack_entry));
+
+    tilepack_header header = pack->header;
+    header.capacity = capacity;
+
+    bool success = fwrite(&header, sizeof(tilepack_header), 1, outfile) == 1
+                && fwrite(entries, sizeof(tilepack_entry), capacity, outfile) == capacity;
+
+    uint64 offset = pack_data_start(capacity);
+    char buffer[4096];
+    for(uint32 i = 0; i < capacity && success; ++i) {
+        if(!(entries[i].flags & TILEPACK_ENTRY_USED)) {
+            continue;
+        }
+
+        success = fseek(pack->file, entries[i].offset, SEEK_SET) == 0;
+        for(uint64 remaining = entries[i].size; remaining > 0 && success;) {
+            size_t chunk = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+            success = fread(buffer, 1, chunk, pack->file) == chunk && fwrite(buffer, 1, chunk, outfile) == chunk;
+            remaining -= chunk;
+        }
+
+        entries[i].offset = offset;
+        offset += entries[i].size;
+    }
+
+    if(success) {
+        success = fseek(outfile, sizeof(tilepack_header), SEEK_SET) == 0
+               && fwrite(entries, sizeof(tilepack_entry), capacity, outfile) == capacity
+               && fflush(outfile) == 0;
+    }
+
+    // The new file stays open across the rename, so the pack never needs to reopen its path.
+    // If anything fails, the old file and its handle are left as they were.
+    success = success && !check_error(rename(temp_path, pack->path) == 0, "Failed to replace pack %s with its compacted copy", pack->path);
+    if(check_error(success, "Failed to compact pack %s", pack->path)) {
+        fclose(outfile);
+        remove(temp_path);
+        sfree(temp_path);
+        sfree(entries);
+        return false;
+    }
+    sfree(temp_path);
+
+    fclose(pack->file);
+    pack->file = outfile;
+
+    sfree(pack->entries);
+    pack->entries = entries;
+    pack->header = header;
+    pack->data_end = offset;
+    pack_lookup_rebuild(pack);
+
+    return true;
+}
+
+// Removes the entry at index, leaving its data behind until the next compaction
+static bool pack_remove_index(tilepack pack, int64 index) {
+    if(index < 0) {
+        return false;
+    }
+
+    pack_lookup_remove(pack, index);
+    pack->live -= pack->entries[index].size;
+    pack->entries[index] = (tilepack_entry){{0}};
+    --pack->header.count;
+
+    return pack_write_entry(pack, index);
+}
+
+// Appends snapshot to the end of the pack, and points the entry for the given key at it
+static bool pack_save(tilepack pack, const char* name, int32 x, int32 y, tilemap_snapshot snapshot) {
+    int64 index = pack_find(pack, name, x, y);
+    if(index < 0 && pack->header.count == pack->header.capacity) {
+        if(!pack_rewrite(pack, pack->header.capacity * 2)) {
+            return false;
+        }
+    }
+
+    // Write the data first, so the index never points at a partial entry
+    if(check_error(fseek(pack->file, pack->data_end, SEEK_SET) == 0, "Failed to seek to the end of pack %s", pack->path)
+    || !fwrite_tilemap_snapshot(pack->file, pack->path, snapshot)) {
+        return false;
+    }
+    long end = ftell(pack->file);
+    if(check_error(end >= 0 && (uint64)end >= pack->data_end, "Failed to find the end of the new entry in pack %s", pack->path)) {
+        return false;
+    }
+    uint64 size = end - pack->data_end;
+
+    if(index < 0) {
+        for(index = 0; pack->entries[index].flags & TILEPACK_ENTRY_USED; ++index);
+
+        tilepack_entry* entry = &pack->entries[index];
+        *entry = (tilepack_entry){{0}};
+        entry->flags = TILEPACK_ENTRY_USED;
+        if(name) {
+            strncpy(entry->name, name, TILEPACK_NAME_LENGTH - 1);
+        } else {
+            entry->flags |= TILEPACK_ENTRY_COORD;
+            entry->x = x;
+            entry->y = y;
+        }
+        ++pack->header.count;
+        pack_lookup_insert(pack, index);
+    } else {
+        pack->live -= pack->entries[index].size;
+    }
+
+    pack->entries[index].offset = pack->data_end;
+    pack->entries[index].size = size;
+    pack->data_end += size;
+    pack->live += size;
+
+    if(!pack_write_entry(pack, index)) {
+        return false;
+    }
+
+    uint64 unused = pack->data_end - pack_data_start(pack->header.capacity) - pack->live;
+    if(unused > TILEPACK_COMPACT_THRESHOLD && unused > pack->live) {
+        return pack_rewrite(pack, pack->header.capacity);
+    }
+
+    return true;
+}
+
+// Loads the map for the given key, if there is one
+static tilemap pack_load(tilepack pack, const char* name, int32 x, int32 y) {
+    int64 index = pack_find(pack, name, x, y);
+    if(index < 0) {
+        return NULL;
+    }
+
+    if(check_error(fseek(pack->file, pack->entries[index].offset, SEEK_SET) == 0, "Failed to seek to an entry in pack %s", pack->path)) {
+        return NULL;
+    }
+    return fread_tilemap(pack->file, pack->path, pack_load_tileset, pack);
+}
+
+// Opens the pack at path. If create is true, a new empty pack is created when none exists. Returns NULL if an error occurs.
+tilepack tilepack_open(const char* path, bool create) {
+    FILE* file = fopen(path, "r+e");
+    bool is_new = false;
+    if(!file && create) {
+        file = fopen(path, "w+e");
+        is_new = true;
+    }
+    check_return(file, "Can't open pack file at %s", NULL, path);
+
+    tilepack pack = mscalloc(1, struct tilepack);
+    pack->path = nstrdup(path);
+    pack->file = file;
+
+    if(is_new) {
+        memcpy(pack->header.magic, TILEPACK_MAGIC, sizeof(pack->header.magic));
+        pack->header.version = TILEPACK_VERSION;
+        pack->header.capacity = TILEPACK_DEFAULT_CAPACITY;
+        pack->entries = mscalloc(pack->header.capacity, tilepack_entry);
+
+        fwrite(&pack->header, sizeof(tilepack_header), 1, file);
+        fwrite(pack->entries, sizeof(tilepack_entry), pack->header.capacity, file);
+        fflush(file);
+    } else {
+        bool valid = fread(&pack->header, sizeof(tilepack_header), 1, file) == 1
+                  && !memcmp(pack->header.magic, TILEPACK_MAGIC, sizeof(pack->header.magic))
+                  && pack->header.version == TILEPACK_VERSION
+                  && pack->header.capacity > 0
+                  && pack->header.count <= pack->header.capacity;
+        if(valid) {
+            pack->entries = mscalloc(pack->header.capacity, tilepack_entry);
+            valid = fread(pack->entries, sizeof(tilepack_entry), pack->header.capacity, file) == pack->header.capacity;
+        }
+
+        // Saving relies on count to know that a free slot exists, so it has to agree with the index
+        uint32 used = 0;
+        for(uint32 i = 0; valid && i < pack->header.capacity; ++i) {
+            used += (pack->entries[i].flags & TILEPACK_ENTRY_USED) != 0;
+        }
+        valid = valid && used == pack->header.count;
+
+        if(check_error(valid, "Pack file %s is invalid", path)) {
+            tilepack_close(pack);
+            return NULL;
+        }
+    }
+
+    pack->data_end = pack_data_start(pack->header.capacity);
+    for(uint32 i = 0; i < pack->header.capacity; ++i) {
+        tilepack_entry* entry = &pack->entries[i];
+        if(entry->flags & TILEPACK_ENTRY_USED) {
+            pack->live += entry->size;
+            if(entry->offset + entry->size > pack->data_end) {
+                pack->data_end = entry->offset + entry->size;
+            }
+        }
+    }
+    pack_lookup_rebuild(pack);
+
+    return pack;
+}
+
+// Closes a pack, and frees the tilesets shared by the maps loaded from it
+void _tilepack_close(tilepack pack) {
+    if(pack->file) {
+        fclose(pack->file);
+    }
+
+    for(uint16 i = 0; i < pack->tileset_count; ++i) {
+        sfree(pack->tilesets[i].path);
+        tileset_cleanup(&pack->tilesets[i].set);
+    }
+    if(pack->tilesets) {
+        sfree(pack->tilesets);
+    }
+    if(pack->entries) {
+        sfree(pack->entries);
+    }
+    if(pack->lookup) {
+        sfree(pack->lookup);
+    }
+    sfree(pack->path);
+    sfree(pack);
+}
+
+// Loads the map stored under name, or returns NULL if there isn't one. The map's tileset is owned by the pack, so free the map without deep.
+tilemap tilepack_load(tilepack pack, const char* name) {
+    check_return(name, "Can't load a map from pack %s without a name", NULL, pack->path);
+    return pack_load(pack, name, 0, 0);
+}
+
+// Loads the map stored at [x, y], or returns NULL if there isn't one. The map's tileset is owned by the pack, so free the map without deep.
+tilemap tilepack_load_at(tilepack pack, int32 x, int32 y) {
+    return pack_load(pack, NULL, x, y);
+}
+
+// Stores map under name, replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save(tilepack pack, const char* name, tilemap map) {
+    tilemap_snapshot snapshot = tilemap_snapshot_new(map);
+    bool result = tilepack_save_snapshot(pack, name, snapshot);
+    tilemap_snapshot_free(snapshot);
+
+    return result;
+}
+
+// Stores map at [x, y], replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save_at(tilepack pack, int32 x, int32 y, tilemap map) {
+    tilemap_snapshot snapshot = tilemap_snapshot_new(map);
+    bool result = tilepack_save_snapshot_at(pack, x, y, snapshot);
+    tilemap_snapshot_free(snapshot);
+
+    return result;
+}
+
+// Stores a snapshot of a map under name, replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save_snapshot(tilepack pack, const char* name, tilemap_snapshot snapshot) {
+    check_return(name, "Can't save a map to pack %s without a name", false, pack->path);
+    check_return(strlen(name) < TILEPACK_NAME_LENGTH, "Entry name %s is too long for pack %s", false, name, pack->path);
+
+    return pack_save(pack, name, 0, 0, snapshot);
+}
+
+// Stores a snapshot of a map at [x, y], replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save_snapshot_at(tilepack pack, int32 x, int32 y, tilemap_snapshot snapshot) {
+    return pack_save(pack, NULL, x, y, snapshot);
+}
+
+// Removes the entry stored under name. Returns false if there wasn't one.
+bool tilepack_remove(tilepack pack, const char* name) {
+    check_return(name, "Can't remove a map from pack %s without a name", false, pack->path);
+    return pack_remove_index(pack, pack_find(pack, name, 0, 0));
+}
+
+// Removes the entry stored at [x, y]. Returns false if there wasn't one.
+bool tilepack_remove_at(tilepack pack, int32 x, int32 y) {
+    return pack_remove_index(pack, pack_find(pack, NULL, x, y));
+}
+
+// Returns true if pack has an entry stored under name
+bool tilepack_contains(tilepack pack, const char* name) {
+    return name && pack_find(pack, name, 0, 0) >= 0;
+}
+
+// Returns true if pack has an entry stored at [x, y]
+bool tilepack_contains_at(tilepack pack, int32 x, int32 y) {
+    return pack_find(pack, NULL, x, y) >= 0;
+}
+
+// Returns the number of entries in pack
+uint32 tilepack_get_count(tilepack pack) {
+    return pack->header.count;
+}
+
+// Rewrites the pack without the space left behind by replaced and removed entries. This happens automatically once most of the file is unused.
+bool tilepack_compact(tilepack pack) {
+    return pack_rewrite(pack, pack->header.capacity);
+}
@@ -0,0 +1,55 @@
+#ifndef DF_TILES_TILEPACK
+#define DF_TILES_TILEPACK
+#include "tilemap.h"
+
+// Longest entry name that a pack can store, including the terminator
+#define TILEPACK_NAME_LENGTH 48
+
+// A single file holding many tilemaps, with an index at the front for random access by name or by coordinate.
+// Packs aren't thread-safe, but a worker thread that owns one can save snapshots of maps that are still being edited.
+declarep(struct, tilepack)
+
+// Opens the pack at path. If create is true, a new empty pack is created when none exists. Returns NULL if an error occurs.
+tilepack tilepack_open(const char* path, bool create);
+
+// Closes a pack, and frees the tilesets shared by the maps loaded from it
+#define tilepack_close(pack) { _tilepack_close(pack); pack = NULL; }
+void _tilepack_close(tilepack pack);
+
+// Loads the map stored under name, or returns NULL if there isn't one. The map's tileset is owned by the pack, so free the map without deep.
+tilemap tilepack_load(tilepack pack, const char* name);
+
+// Loads the map stored at [x, y], or returns NULL if there isn't one. The map's tileset is owned by the pack, so free the map without deep.
+tilemap tilepack_load_at(tilepack pack, int32 x, int32 y);
+
+// Stores map under name, replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save(tilepack pack, const char* name, tilemap map);
+
+// Stores map at [x, y], replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save_at(tilepack pack, int32 x, int32 y, tilemap map);
+
+// Stores a snapshot of a map under name, replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save_snapshot(tilepack pack, const char* name, tilemap_snapshot snapshot);
+
+// Stores a snapshot of a map at [x, y], replacing any existing entry. Returns false if an error occurs.
+bool tilepack_save_snapshot_at(tilepack pack, int32 x, int32 y, tilemap_snapshot snapshot);
+
+// Removes the entry stored under name. Returns false if there wasn't one.
+bool tilepack_remove(tilepack pack, const char* name);
+
+// Removes the entry stored at [x, y]. Returns false if there wasn't one.
+bool tilepack_remove_at(tilepack pack, int32 x, int32 y);
+
+// Returns true if pack has an entry stored under name
+bool tilepack_contains(tilepack pack, const char* name);
+
+// Returns true if pack has an entry stored at [x, y]
+bool tilepack_contains_at(tilepack pack, int32 x, int32 y);
+
+// Returns the number of entries in pack
+uint32 tilepack_get_count(tilepack pack);
+
+// Rewrites the pack without the space left behind by replaced and removed entries. This happens automatically once most of the file is unused.
+bool tilepack_compact(tilepack pack);
+
+#endif
@@ -4,9 +4,41 @@
 #include "tileset.h"
 
 #include "core/check.h"
+#include "core/stringutil.h"
+
+#include <string.h>
 
 const tileset tileset_empty = {{0}};
 
+// Allocates zeroed memory for set's dynamic contents, from its arena if it has one
+static void* tileset_alloc(const tileset* set, size_t count, size_t size) {
+    return set->arena ? tile_arena_alloc(set->arena, count * size) : scalloc(count, size);
+}
+
+// Grows one of set's arrays from count to count + 1 entries of size bytes
+static void* tileset_grow(const tileset* set, void* data, size_t count, size_t size) {
+    if(!set->arena) {
+        return srealloc(data, (count + 1) * size);
+    }
+
+    void* result = tile_arena_alloc(set->arena, (count + 1) * size);
+    if(data) {
+        memcpy(result, data, count * size);
+    }
+    return result;
+}
+
+static char* tileset_strdup(const tileset* set, const char* str) {
+    return set->arena ? tile_arena_strdup(set->arena, str) : nstrdup(str);
+}
+
+// Frees memory from tileset_alloc. Arena memory is only released when the arena is reset.
+static void tileset_release(const tileset* set, void* data) {
+    if(data && !set->arena) {
+        sfree(data);
+    }
+}
+
 // Returns the uv bounding box for the given tile index
 aabb_2d tileset_get_tile(tileset set, uint16 tile) {
     check_return(tile < set.width * set.height, "Requested tile index %d is out of bounds. (Tileset length is %d)", aabb_2d_zero, tile, set.width * set.height);
@@ -17,7 +49,11 @@ aabb_2d tileset_get_tile(tileset set, uint16 tile) {
     uint16 tile_y = tile / set.width;
     box.position.x += tile_x * (set.tile_box.dimensions.x + set.tile_box.position.x) - set.tile_box.position.x;
     box.position.y += tile_y * (set.tile_box.dimensions.y + set.tile_box.position.y) - set.tile_box.position.y;
-    box.dimensions.y -= 0.1 / (float)set.tex.height;
+
+    // Without a gutter, the next row's texels can bleed in, so trim a fraction of a texel off
+    if(set.padding == 0) {
+        box.dimensions.y -= 0.1 / (float)set.tex.height;
+    }
 
     return box;
 }
@@ -37,13 +73,239 @@ void tileset_set_mask(tileset* set, uint16 tile, uint8 mask) {
     check_return(tile < set->width * set->height, "Requested tile index %d is out of bounds. (Tileset length is %d)", );
 
     if(!set->tile_mask) {
-        set->tile_mask = mscalloc(set->width * set->height, uint8);
+        set->tile_mask = tileset_alloc(set, set->width * set->height, sizeof(uint8));
     }
 
     set->tile_mask[tile] = mask;
 }
 
-// Sets the dimensions (in tiles) of the tileset, and updates the mask accordingly
+// Returns the size of a single value in a column of the given type
+static size_t property_value_size(tile_property_type type) {
+    switch(type) {
+        case TILE_PROPERTY_INT:
+            return sizeof(int32);
+        case TILE_PROPERTY_FLOAT:
+            return sizeof(float);
+        case TILE_PROPERTY_BOOL:
+            return sizeof(bool);
+        case TILE_PROPERTY_STRING:
+            return sizeof(char*);
+    }
+
+    return 0;
+}
+
+// Returns the column called name if it holds type, or NULL otherwise
+static const tile_property* tileset_get_column(tileset set, const char* name, tile_property_type type) {
+    uint8 index = tileset_find_property(set, name);
+    if(index == NO_PROPERTY || set.properties[index].type != type) {
+        return NULL;
+    }
+
+    return &set.properties[index];
+}
+
+// Returns the column for setting a value of tile, adding it if needed. Returns NULL if an error occurs.
+static tile_property* tileset_prepare_property(tileset* set, uint16 tile, const char* name, tile_property_type type) {
+    check_return(tile < set->width * set->height, "Requested tile index %d is out of bounds. (Tileset length is %d)", NULL, tile, set->width * set->height);
+
+    uint8 index = tileset_add_property(set, name, type);
+    if(index == NO_PROPERTY) {
+        return NULL;
+    }
+
+    return &set->properties[index];
+}
+
+// Returns the index of the property called name, or NO_PROPERTY if set doesn't have one
+uint8 tileset_find_property(tileset set, const char* name) {
+    check_return(name, "Can't find a tileset property without a name", NO_PROPERTY);
+
+    for(uint8 i = 0; i < set.property_count; ++i) {
+        if(!strcmp(set.properties[i].name, name)) {
+            return i;
+        }
+    }
+
+    return NO_PROPERTY;
+}
+
+// Adds an empty property column called name to set, unless it already has one. Returns the column's index, or NO_PROPERTY if a column with that name has a different type.
+uint8 tileset_add_property(tileset* set, const char* name, tile_property_type type) {
+    check_return(name, "Can't add a tileset property without a name", NO_PROPERTY);
+
+    uint8 index = tileset_find_property(*set, name);
+    if(index != NO_PROPERTY) {
+        check_return(set->properties[index].type == type, "Tileset property %s already exists with a different type", NO_PROPERTY, name);
+        return index;
+    }
+    check_return(set->property_count < NO_PROPERTY, "Tileset has too many properties to add %s", NO_PROPERTY, name);
+
+    set->properties = tileset_grow(set, set->properties, set->property_count, sizeof(tile_property));
+    tile_property* prop = &set->properties[set->property_count];
+    prop->name = tileset_strdup(set, name);
+    prop->type = type;
+    prop->data = set->width * set->height > 0 ? tileset_alloc(set, set->width * set->height, property_value_size(type)) : NULL;
+
+    return set->property_count++;
+}
+
+// Sets the value of an int property for the given tile index, adding the column if needed
+void tileset_set_property_int(tileset* set, uint16 tile, const char* name, int32 value) {
+    tile_property* prop = tileset_prepare_property(set, tile, name, TILE_PROPERTY_INT);
+    if(prop) {
+        prop->ints[tile] = value;
+    }
+}
+
+// Sets the value of a float property for the given tile index, adding the column if needed
+void tileset_set_property_float(tileset* set, uint16 tile, const char* name, float value) {
+    tile_property* prop = tileset_prepare_property(set, tile, name, TILE_PROPERTY_FLOAT);
+    if(prop) {
+        prop->floats[tile] = value;
+    }
+}
+
+// Sets the value of a bool property for the given tile index, adding the column if needed
+void tileset_set_property_bool(tileset* set, uint16 tile, const char* name, bool value) {
+    tile_property* prop = tileset_prepare_property(set, tile, name, TILE_PROPERTY_BOOL);
+    if(prop) {
+        prop->bools[tile] = value;
+    }
+}
+
+// Sets the value of a string property for the given tile index, adding the column if needed. The string is copied.
+void tileset_set_property_string(tileset* set, uint16 tile, const char* name, const char* value) {
+    tile_property* prop = tileset_prepare_property(set, tile, name, TILE_PROPERTY_STRING);
+    if(prop) {
+        tileset_release(set, prop->strings[tile]);
+        prop->strings[tile] = value ? tileset_strdup(set, value) : NULL;
+    }
+}
+
+// Returns the values of the int property called name, indexed by tile. Returns NULL if set has no such column, or it holds another type.
+const int32* tileset_get_int_column(tileset set, const char* name) {
+    const tile_property* prop = tileset_get_column(set, name, TILE_PROPERTY_INT);
+    return prop ? prop->ints : NULL;
+}
+
+// Returns the values of the float property called name, indexed by tile. Returns NULL if set has no such column, or it holds another type.
+const float* tileset_get_float_column(tileset set, const char* name) {
+    const tile_property* prop = tileset_get_column(set, name, TILE_PROPERTY_FLOAT);
+    return prop ? prop->floats : NULL;
+}
+
+// Returns the values of the bool property called name, indexed by tile. Returns NULL if set has no such column, or it holds another type.
+const bool* tileset_get_bool_column(tileset set, const char* name) {
+    const tile_property* prop = tileset_get_column(set, name, TILE_PROPERTY_BOOL);
+    return prop ? prop->bools : NULL;
+}
+
+// Returns the values of the string property called name, indexed by tile. Tiles without a value are NULL. Returns NULL if set has no such column, or it holds another type.
+char* const* tileset_get_string_column(tileset set, const char* name) {
+    const tile_property* prop = tileset_get_column(set, name, TILE_PROPERTY_STRING);
+    return prop ? prop->strings : NULL;
+}
+
+// Copies the mask and every property value of src's tile into dest's tile, adding columns to dest as needed
+void tileset_copy_tile_data(tileset* dest, uint16 dest_tile, tileset src, uint16 src_tile) {
+    check_return(src_tile < src.width * src.height, "Requested tile index %d is out of bounds. (Tileset length is %d)", , src_tile, src.width * src.height);
+
+    uint8 mask = tileset_get_mask(src, src_tile);
+    if(mask != 0) {
+        tileset_set_mask(dest, dest_tile, mask);
+    }
+
+    for(uint8 i = 0; i < src.property_count; ++i) {
+        const tile_property* prop = &src.properties[i];
+        switch(prop->type) {
+            case TILE_PROPERTY_INT:
+                tileset_set_property_int(dest, dest_tile, prop->name, prop->ints[src_tile]);
+                break;
+            case TILE_PROPERTY_FLOAT:
+                tileset_set_property_float(dest, dest_tile, prop->name, prop->floats[src_tile]);
+                break;
+            case TILE_PROPERTY_BOOL:
+                tileset_set_property_bool(dest, dest_tile, prop->name, prop->bools[src_tile]);
+                break;
+            case TILE_PROPERTY_STRING:
+                tileset_set_property_string(dest, dest_tile, prop->name, prop->strings[src_tile]);
+                break;
+        }
+    }
+}
+
+// Returns the index of the terrain called name, or NO_TERRAIN if set doesn't have one
+uint8 tileset_find_terrain(tileset set, const char* name) {
+    check_return(name, "Can't find a terrain without a name", NO_TERRAIN);
+
+    for(uint8 i = 0; i < set.terrain_count; ++i) {
+        if(!strcmp(set.terrains[i].name, name)) {
+            return i;
+        }
+    }
+
+    return NO_TERRAIN;
+}
+
+// Adds a terrain without any rules to set, unless it already has one called name. Returns the terrain's index, or NO_TERRAIN if an error occurs.
+uint8 tileset_add_terrain(tileset* set, const char* name) {
+    check_return(name, "Can't add a terrain without a name", NO_TERRAIN);
+
+    uint8 index = tileset_find_terrain(*set, name);
+    if(index != NO_TERRAIN) {
+        return index;
+    }
+    // The highest indices are reserved, so that autotiling can mark cells outside of any terrain or the map
+    check_return(set->terrain_count < NO_TERRAIN - 1, "Tileset has too many terrains to add %s", NO_TERRAIN, name);
+
+    set->terrains = tileset_grow(set, set->terrains, set->terrain_count, sizeof(tile_terrain));
+    tile_terrain* terrain = &set->terrains[set->terrain_count];
+    terrain->name = tileset_strdup(set, name);
+    for(uint16 i = 0; i < 256; ++i) {
+        terrain->rules[i] = NO_TILE;
+    }
+
+    return set->terrain_count++;
+}
+
+// Makes terrain use tile where its neighbours match mask. Pass NO_TILE to remove the rule.
+void tileset_set_terrain_rule(tileset* set, uint8 terrain, uint8 mask, uint16 tile) {
+    check_return(terrain < set->terrain_count, "Requested terrain index %d is out of bounds. (Tileset has %d terrains)", , terrain, set->terrain_count);
+    check_return(tile == NO_TILE || tile < set->width * set->height, "Requested tile index %d is out of bounds. (Tileset length is %d)", , tile, set->width * set->height);
+
+    set->terrains[terrain].rules[mask] = tile;
+}
+
+// Moves a column's values to a new layout, keeping the ones that still fit
+static void property_resize(const tileset* set, tile_property* prop, uint16 old_width, uint16 old_height, uint16 width, uint16 height) {
+    size_t size = property_value_size(prop->type);
+    ubyte* old_data = prop->data;
+    ubyte* data = width * height > 0 ? tileset_alloc(set, width * height, size) : NULL;
+
+    uint16 copy_width = width < old_width ? width : old_width;
+    uint16 copy_height = height < old_height ? height : old_height;
+    for(uint16 i = 0; i < copy_height; ++i) {
+        memcpy(data + i * width * size, old_data + i * old_width * size, copy_width * size);
+    }
+
+    // Strings that didn't make it into the new layout would leak
+    if(prop->type == TILE_PROPERTY_STRING) {
+        for(uint16 i = 0; i < old_height; ++i) {
+            for(uint16 j = 0; j < old_width; ++j) {
+                char* str = prop->strings[i * old_width + j];
+                if(i >= copy_height || j >= copy_width) {
+                    tileset_release(set, str);
+                }
+            }
+        }
+    }
+
+    tileset_release(set, old_data);
+    prop->data = data;
+}
+
+// Sets the dimensions (in tiles) of the tileset, and updates the mask, properties and terrains accordingly
 void tileset_resize(tileset* set, uint16 width, uint16 height) {
     uint16 old_width = set->width;
     uint16 old_height = set->height;
@@ -54,7 +316,7 @@ void tileset_resize(tileset* set, uint16 width, uint16 height) {
 
     if(old_mask) {
         if(width * height > 0) {
-            set->tile_mask = mscalloc(set->width * set->height, uint8);
+            set->tile_mask = tileset_alloc(set, set->width * set->height, sizeof(uint8));
             for(uint16 i = 0; i < set->height && i < old_height; ++i) {
                 for(uint16 j = 0; j < set->width && j < old_width; ++j) {
                     if(old_mask[i * old_width + j] != 0) {
@@ -66,7 +328,25 @@ void tileset_resize(tileset* set, uint16 width, uint16 height) {
             set->tile_mask = NULL;
         }
 
-        sfree(old_mask);
+        tileset_release(set, old_mask);
+    }
+
+    for(uint8 i = 0; i < set->property_count; ++i) {
+        property_resize(set, &set->properties[i], old_width, old_height, width, height);
+    }
+
+    // Terrain rules refer to tiles by index, so follow each tile to its new index
+    for(uint8 i = 0; i < set->terrain_count; ++i) {
+        uint16* rules = set->terrains[i].rules;
+        for(uint16 j = 0; j < 256; ++j) {
+            if(rules[j] == NO_TILE) {
+                continue;
+            }
+
+            uint16 x = rules[j] % old_width;
+            uint16 y = rules[j] / old_width;
+            rules[j] = x < width && y < height ? y * width + x : NO_TILE;
+        }
     }
 }
 
@@ -81,6 +361,27 @@ void tileset_cleanup(tileset* set) {
     gltex_cleanup(&set->tex);
     if(set->asset_path)
         sfree(set->asset_path);
-    if(set->tile_mask)
-        sfree(set->tile_mask);
+    tileset_release(set, set->tile_mask);
+    set->tile_mask = NULL;
+
+    for(uint8 i = 0; i < set->property_count; ++i) {
+        tile_property* prop = &set->properties[i];
+        if(prop->type == TILE_PROPERTY_STRING) {
+            for(uint32 j = 0; j < set->width * set->height; ++j) {
+                tileset_release(set, prop->strings[j]);
+            }
+        }
+        tileset_release(set, prop->data);
+        tileset_release(set, prop->name);
+    }
+    tileset_release(set, set->properties);
+    set->properties = NULL;
+    set->property_count = 0;
+
+    for(uint8 i = 0; i < set->terrain_count; ++i) {
+        tileset_release(set, set->terrains[i].name);
+    }
+    tileset_release(set, set->terrains);
+    set->terrains = NULL;
+    set->terrain_count = 0;
 }
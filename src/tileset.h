@@ -4,8 +4,48 @@
 #include "graphics/texture.h"
 #include "math/aabb.h"
 
+#include "tile_arena.h"
+
 #define NO_TILE UINT16_MAX
 
+// Returned by tileset_find_property when a set has no property with the given name
+#define NO_PROPERTY UINT8_MAX
+
+typedef enum tile_property_type {
+    TILE_PROPERTY_INT,
+    TILE_PROPERTY_FLOAT,
+    TILE_PROPERTY_BOOL,
+    TILE_PROPERTY_STRING
+} tile_property_type;
+
+// A named column of gameplay data, with one value per tile in the set
+typedef struct tile_property {
+    char* name;
+    tile_property_type type;
+
+    union {
+        int32* ints;
+        float* floats;
+        bool* bools;
+        char** strings;
+
+        // Untyped access, for code that handles every type
+        void* data;
+    };
+} tile_property;
+
+// Returned by tileset_find_terrain when a set has no terrain with the given name
+#define NO_TERRAIN UINT8_MAX
+
+// An autotiling terrain: which tile to draw for each combination of neighbours that share the terrain.
+// Masks use one bit per neighbour, clockwise from north: N=1, NE=2, E=4, SE=8, S=16, SW=32, W=64, NW=128.
+typedef struct tile_terrain {
+    char* name;
+
+    // Tile for each neighbour mask, as given in the tileset file. NO_TILE where there's no rule.
+    uint16 rules[256];
+} tile_terrain;
+
 typedef struct tileset {
     gltex tex;
 
@@ -15,9 +55,21 @@ typedef struct tileset {
     uint16 width;
     uint16 height;
 
+    // Gutter around each tile, in pixels. Padded tilesets don't need their UVs trimmed to avoid bleeding.
+    uint8 padding;
+
     char* asset_path;
 
     uint8* tile_mask;
+
+    tile_property* properties;
+    uint8 property_count;
+
+    tile_terrain* terrains;
+    uint8 terrain_count;
+
+    // If set, masks, properties and terrains are allocated from this arena instead of the heap
+    tile_arena arena;
 } tileset;
 
 const extern tileset tileset_empty;
@@ -31,7 +83,49 @@ uint8 tileset_get_mask(tileset set, uint16 tile);
 // Sets the bitmask for the given tile index
 void tileset_set_mask(tileset* set, uint16 tile, uint8 mask);
 
-// Sets the dimensions (in tiles) of the tileset, and updates the mask accordingly
+// Returns the index of the property called name, or NO_PROPERTY if set doesn't have one
+uint8 tileset_find_property(tileset set, const char* name);
+
+// Adds an empty property column called name to set, unless it already has one. Returns the column's index, or NO_PROPERTY if a column with that name has a different type.
+uint8 tileset_add_property(tileset* set, const char* name, tile_property_type type);
+
+// Sets the value of an int property for the given tile index, adding the column if needed
+void tileset_set_property_int(tileset* set, uint16 tile, const char* name, int32 value);
+
+// Sets the value of a float property for the given tile index, adding the column if needed
+void tileset_set_property_float(tileset* set, uint16 tile, const char* name, float value);
+
+// Sets the value of a bool property for the given tile index, adding the column if needed
+void tileset_set_property_bool(tileset* set, uint16 tile, const char* name, bool value);
+
+// Sets the value of a string property for the given tile index, adding the column if needed. The string is copied.
+void tileset_set_property_string(tileset* set, uint16 tile, const char* name, const char* value);
+
+// Returns the values of the int property called name, indexed by tile. Returns NULL if set has no such column, or it holds another type.
+const int32* tileset_get_int_column(tileset set, const char* name);
+
+// Returns the values of the float property called name, indexed by tile. Returns NULL if set has no such column, or it holds another type.
+const float* tileset_get_float_column(tileset set, const char* name);
+
+// Returns the values of the bool property called name, indexed by tile. Returns NULL if set has no such column, or it holds another type.
+const bool* tileset_get_bool_column(tileset set, const char* name);
+
+// Returns the values of the string property called name, indexed by tile. Tiles without a value are NULL. Returns NULL if set has no such column, or it holds another type.
+char* const* tileset_get_string_column(tileset set, const char* name);
+
+// Copies the mask and every property value of src's tile into dest's tile, adding columns to dest as needed
+void tileset_copy_tile_data(tileset* dest, uint16 dest_tile, tileset src, uint16 src_tile);
+
+// Returns the index of the terrain called name, or NO_TERRAIN if set doesn't have one
+uint8 tileset_find_terrain(tileset set, const char* name);
+
+// Adds a terrain without any rules to set, unless it already has one called name. Returns the terrain's index, or NO_TERRAIN if an error occurs.
+uint8 tileset_add_terrain(tileset* set, const char* name);
+
+// Makes terrain use tile where its neighbours match mask. Pass NO_TILE to remove the rule.
+void tileset_set_terrain_rule(tileset* set, uint8 terrain, uint8 mask, uint16 tile);
+
+// Sets the dimensions (in tiles) of the tileset, and updates the mask, properties and terrains accordingly
 void tileset_resize(tileset* set, uint16 width, uint16 height);
 
 // Calculates the dimensions of a tile, in pixels
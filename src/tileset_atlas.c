@@ -0,0 +1,265 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tileset_atlas.h"
+
+#include "core/check.h"
+
+#include <math.h>
+#include <string.h>
+
+#define ATLAS_CHANNELS 4
+
+const atlas_options atlas_options_default = { .padding = 2, .extrude = 2, .mipmaps = true };
+
+typedef struct atlas_source {
+    gltex tex;
+
+    // Only used for tileset sources
+    tileset set;
+    bool is_image;
+
+    uint16 first;
+    uint16 count;
+} atlas_source;
+
+typedef struct tile_atlas {
+    atlas_options options;
+
+    uint16 tile_width;
+    uint16 tile_height;
+
+    atlas_source* sources;
+    uint16 source_count;
+
+    uint16* remap;
+    uint16 tile_count;
+}* tile_atlas;
+
+// Returns the smallest power of two that is >= value
+static uint32 next_pow2(uint32 value) {
+    uint32 result = 1;
+    while(result < value) {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+// Checks a new source's tile dimensions against the atlas, and appends its tiles to the remap table
+static uint16 tile_atlas_push_source(tile_atlas atlas, atlas_source source, uint16 tile_width, uint16 tile_height) {
+    check_return(tile_width != 0 && tile_height != 0, "Can't add a source with empty tiles to an atlas", NO_TILE);
+    check_return(source.count > 0, "Can't add a source with no tiles to an atlas", NO_TILE);
+    check_return((uint32)atlas->tile_count + source.count < NO_TILE, "Atlas is full, can't add %d more tiles", NO_TILE, source.count);
+
+    if(atlas->source_count == 0) {
+        atlas->tile_width = tile_width;
+        atlas->tile_height = tile_height;
+    } else {
+        check_return(atlas->tile_width == tile_width && atlas->tile_height == tile_height, "Can't add %dx%d tiles to an atlas of %dx%d tiles", NO_TILE, tile_width, tile_height, atlas->tile_width, atlas->tile_height);
+    }
+
+    source.first = atlas->tile_count;
+
+    atlas->sources = srealloc(atlas->sources, (atlas->source_count + 1) * sizeof(atlas_source));
+    atlas->sources[atlas->source_count] = source;
+
+    atlas->remap = srealloc(atlas->remap, (atlas->tile_count + source.count) * sizeof(uint16));
+    for(uint16 i = 0; i < source.count; ++i) {
+        atlas->remap[source.first + i] = source.first + i;
+    }
+    atlas->tile_count += source.count;
+
+    return atlas->source_count++;
+}
+
+// Reads back the pixels of tex as RGBA. The result must be freed by the caller.
+static ubyte* atlas_read_pixels(gltex tex) {
+    ubyte* pixels = mscalloc(tex.width * tex.height * ATLAS_CHANNELS, ubyte);
+
+    glBindTexture(GL_TEXTURE_2D, tex.handle);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    return pixels;
+}
+
+// Copies a tile from src into dest, repeating its outer pixels extrude times in each direction
+static void atlas_blit(ubyte* dest, uint32 dest_width, uint32 dest_x, uint32 dest_y, const ubyte* src, uint16 src_width, uint16 src_height, int32 src_x, int32 src_y, uint16 tile_width, uint16 tile_height, uint8 extrude) {
+    for(int32 i = -extrude; i < tile_height + extrude; ++i) {
+        int32 row = src_y + (i < 0 ? 0 : (i >= tile_height ? tile_height - 1 : i));
+        if(row < 0 || row >= src_height) {
+            continue;
+        }
+
+        for(int32 j = -extrude; j < tile_width + extrude; ++j) {
+            int32 col = src_x + (j < 0 ? 0 : (j >= tile_width ? tile_width - 1 : j));
+            if(col < 0 || col >= src_width) {
+                continue;
+            }
+
+            memcpy(dest + ((dest_y + i) * dest_width + dest_x + j) * ATLAS_CHANNELS, src + (row * src_width + col) * ATLAS_CHANNELS, ATLAS_CHANNELS);
+        }
+    }
+}
+
+// Creates a new empty atlas builder
+tile_atlas tile_atlas_new(atlas_options options) {
+    tile_atlas atlas = mscalloc(1, struct tile_atlas);
+
+    if(check_warn(options.extrude <= options.padding, "Atlas extrusion (%d) is larger than its padding (%d), clamping", options.extrude, options.padding)) {
+        options.extrude = options.padding;
+    }
+    atlas->options = options;
+
+    return atlas;
+}
+
+// Frees an atlas builder. Tilesets built from it remain valid.
+void _tile_atlas_free(tile_atlas atlas) {
+    if(atlas->sources) {
+        sfree(atlas->sources);
+    }
+    if(atlas->remap) {
+        sfree(atlas->remap);
+    }
+    sfree(atlas);
+}
+
+// Adds every tile of set to the atlas, and returns the source index used for remapping. All sources must share the same tile dimensions.
+// Only a reference to set's texture is kept, so set and its texture must stay alive until tile_atlas_build.
+uint16 tile_atlas_add_tileset(tile_atlas atlas, tileset set) {
+    check_return(set.tex.handle != 0, "Can't add a tileset without a texture to an atlas", NO_TILE);
+
+    vec2 dims = tileset_get_tile_dims(set);
+    atlas_source source = { .tex = set.tex, .set = set, .is_image = false, .count = set.width * set.height };
+
+    return tile_atlas_push_source(atlas, source, (uint16)roundf(dims.x), (uint16)roundf(dims.y));
+}
+
+// Adds a loose image to the atlas as a single tile, and returns the source index used for remapping. tex must stay alive until tile_atlas_build.
+uint16 tile_atlas_add_image(tile_atlas atlas, gltex tex) {
+    check_return(tex.handle != 0, "Can't add an empty image to an atlas", NO_TILE);
+
+    atlas_source source = { .tex = tex, .set = tileset_empty, .is_image = true, .count = 1 };
+
+    return tile_atlas_push_source(atlas, source, tex.width, tex.height);
+}
+
+// Packs all sources into a single texture, and returns a tileset that uses it. Returns tileset_empty if nothing could be packed.
+// Source pixels are read back with glGetTexImage, so this needs desktop GL rather than GLES.
+tileset tile_atlas_build(tile_atlas atlas) {
+    check_return(atlas->tile_count > 0, "Can't build an empty atlas", tileset_empty);
+
+    uint8 padding = atlas->options.padding;
+    uint32 cell_width = atlas->tile_width + padding * 2;
+    uint32 cell_height = atlas->tile_height + padding * 2;
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+    // Aim for a roughly square power-of-two texture
+    uint32 tex_width = next_pow2((uint32)ceilf(sqrtf((float)atlas->tile_count * cell_width * cell_height)));
+    if(tex_width > (uint32)max_size) {
+        tex_width = max_size;
+    }
+    check_return(tex_width >= cell_width, "Atlas tiles are larger than the maximum texture size %d", tileset_empty, max_size);
+
+    uint32 columns = tex_width / cell_width;
+    uint32 rows = (atlas->tile_count + columns - 1) / columns;
+    uint32 tex_height = next_pow2(rows * cell_height);
+    check_return(tex_height <= (uint32)max_size, "Atlas of %d tiles doesn't fit in the maximum texture size %d", tileset_empty, atlas->tile_count, max_size);
+
+    // Tilesets count their tiles in a uint16, so a wider grid would wrap
+    check_return(columns * rows <= UINT16_MAX, "Atlas grid of %dx%d cells is too large for a tileset", tileset_empty, columns, rows);
+
+    ubyte* pixels = mscalloc(tex_width * tex_height * ATLAS_CHANNELS, ubyte);
+    tileset set = tileset_empty;
+    tileset_resize(&set, columns, rows);
+
+    for(uint16 i = 0; i < atlas->source_count; ++i) {
+        atlas_source* source = &atlas->sources[i];
+        ubyte* src = atlas_read_pixels(source->tex);
+
+        for(uint16 j = 0; j < source->count; ++j) {
+            uint16 id = atlas->remap[source->first + j];
+            int32 src_x = 0;
+            int32 src_y = 0;
+            if(!source->is_image) {
+                aabb_2d box = tileset_get_tile(source->set, j);
+                src_x = (int32)roundf(box.position.x * source->tex.width);
+                src_y = (int32)roundf(box.position.y * source->tex.height);
+
+                tileset_copy_tile_data(&set, id, source->set, j);
+            }
+
+            atlas_blit(pixels, tex_width, (id % columns) * cell_width + padding, (id / columns) * cell_height + padding,
+                       src, source->tex.width, source->tex.height, src_x, src_y,
+                       atlas->tile_width, atlas->tile_height, atlas->options.extrude);
+        }
+
+        // Terrains with the same name are merged, so sets can split one terrain's tiles between them
+        for(uint8 j = 0; !source->is_image && j < source->set.terrain_count; ++j) {
+            const tile_terrain* terrain = &source->set.terrains[j];
+            uint8 index = tileset_add_terrain(&set, terrain->name);
+            for(uint16 k = 0; k < 256 && index != NO_TERRAIN; ++k) {
+                if(terrain->rules[k] != NO_TILE && terrain->rules[k] < source->count) {
+                    tileset_set_terrain_rule(&set, index, k, atlas->remap[source->first + terrain->rules[k]]);
+                }
+            }
+        }
+
+        sfree(src);
+    }
+
+    set.tex.type = GL_TEXTURE_2D;
+    set.tex.width = tex_width;
+    set.tex.height = tex_height;
+    glGenTextures(1, &set.tex.handle);
+    glBindTexture(GL_TEXTURE_2D, set.tex.handle);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_width, tex_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Each mip level halves the gutter, so stop before neighbouring tiles start to blend together
+    if(atlas->options.mipmaps && padding > 1) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)floorf(log2f(padding)));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
+    sfree(pixels);
+
+    // tileset_get_tile places tile 0 at offset - tile_offset, so the set offset has to include one gutter
+    set.padding = padding;
+    set.tile_box.dimensions = (vec2){ .x = (float)atlas->tile_width / tex_width, .y = (float)atlas->tile_height / tex_height };
+    set.tile_box.position = (vec2){ .x = (float)(padding * 2) / tex_width, .y = (float)(padding * 2) / tex_height };
+    set.offset = (vec2){ .x = (float)(padding * 3) / tex_width, .y = (float)(padding * 3) / tex_height };
+
+    return set;
+}
+
+// Returns the packed tile id for the given tile from the given source, or NO_TILE if either is invalid
+uint16 tile_atlas_remap(tile_atlas atlas, uint16 source, uint16 tile) {
+    check_return(source < atlas->source_count, "Requested atlas source %d is out of bounds. (Atlas has %d sources)", NO_TILE, source, atlas->source_count);
+    if(tile >= atlas->sources[source].count) {
+        return NO_TILE;
+    }
+
+    return atlas->remap[atlas->sources[source].first + tile];
+}
+
+// Returns the remapping table for source, and stores its length in count. The table is owned by the atlas.
+const uint16* tile_atlas_get_remap_table(tile_atlas atlas, uint16 source, uint16* count) {
+    check_return(source < atlas->source_count, "Requested atlas source %d is out of bounds. (Atlas has %d sources)", NULL, source, atlas->source_count);
+
+    if(count) {
+        *count = atlas->sources[source].count;
+    }
+
+    return atlas->remap + atlas->sources[source].first;
+}
@@ -0,0 +1,44 @@
+#ifndef DF_TILES_TILESET_ATLAS
+#define DF_TILES_TILESET_ATLAS
+#include "tileset.h"
+
+declarep(struct, tile_atlas)
+
+typedef struct atlas_options {
+    // Transparent gutter around each tile, in pixels
+    uint8 padding;
+
+    // Number of pixels to repeat each tile's edges into its gutter. Clamped to padding.
+    uint8 extrude;
+
+    // If true, mipmaps are generated for the packed texture
+    bool mipmaps;
+} atlas_options;
+
+const extern atlas_options atlas_options_default;
+
+// Creates a new empty atlas builder
+tile_atlas tile_atlas_new(atlas_options options);
+
+// Frees an atlas builder. Tilesets built from it remain valid.
+#define tile_atlas_free(atlas) { _tile_atlas_free(atlas); atlas = NULL; }
+void _tile_atlas_free(tile_atlas atlas);
+
+// Adds every tile of set to the atlas, and returns the source index used for remapping. All sources must share the same tile dimensions.
+// Only a reference to set's texture is kept, so set and its texture must stay alive until tile_atlas_build.
+uint16 tile_atlas_add_tileset(tile_atlas atlas, tileset set);
+
+// Adds a loose image to the atlas as a single tile, and returns the source index used for remapping. tex must stay alive until tile_atlas_build.
+uint16 tile_atlas_add_image(tile_atlas atlas, gltex tex);
+
+// Packs all sources into a single texture, and returns a tileset that uses it. Returns tileset_empty if nothing could be packed.
+// Source pixels are read back with glGetTexImage, so this needs desktop GL rather than GLES.
+tileset tile_atlas_build(tile_atlas atlas);
+
+// Returns the packed tile id for the given tile from the given source, or NO_TILE if either is invalid
+uint16 tile_atlas_remap(tile_atlas atlas, uint16 source, uint16 tile);
+
+// Returns the remapping table for source, and stores its length in count. The table is owned by the atlas.
+const uint16* tile_atlas_get_remap_table(tile_atlas atlas, uint16 source, uint16* count);
+
+#endif
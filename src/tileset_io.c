@@ -12,6 +12,249 @@
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include <libxml/xmlwriter.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Names of each tile_property_type, as written in tileset files
+static const char* property_type_names[] = { "int", "float", "bool", "string" };
+
+// Parses the type of a <property> element. Tiled's extra types are stored as the closest basic type.
+static bool xml_parse_property_type(const char* name, tile_property_type* type) {
+    if(!name || !strcmp(name, "string") || !strcmp(name, "file") || !strcmp(name, "color")) {
+        *type = TILE_PROPERTY_STRING;
+    } else if(!strcmp(name, "int") || !strcmp(name, "object")) {
+        *type = TILE_PROPERTY_INT;
+    } else if(!strcmp(name, "float")) {
+        *type = TILE_PROPERTY_FLOAT;
+    } else if(!strcmp(name, "bool")) {
+        *type = TILE_PROPERTY_BOOL;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// Reads a <property> element. If tile is NO_TILE, this only declares the column.
+static void xml_read_tile_property(xmlNodePtr node, tileset* set, uint16 tile, const char* path) {
+    char* name = NULL;
+    char* type_name = NULL;
+    char* value = NULL;
+    if(!xml_property_read(node, "name", &name)) {
+        warn("Tileset %s has a property without a name", path);
+        return;
+    }
+    xml_property_read(node, "type", &type_name);
+
+    tile_property_type type;
+    if(!xml_parse_property_type(type_name, &type)) {
+        warn("Tileset %s has property %s with unsupported type %s", path, name, type_name);
+    } else if(tileset_add_property(set, name, type) != NO_PROPERTY && tile != NO_TILE) {
+        // Tiled stores multi-line strings as the element's content instead
+        xmlChar* content = NULL;
+        if(!xml_property_read(node, "value", &value)) {
+            content = xmlNodeGetContent(node);
+        }
+        const char* text = value ? value : (const char*)content;
+
+        switch(type) {
+            case TILE_PROPERTY_INT:
+                tileset_set_property_int(set, tile, name, text ? strtol(text, NULL, 10) : 0);
+                break;
+            case TILE_PROPERTY_FLOAT:
+                tileset_set_property_float(set, tile, name, text ? strtof(text, NULL) : 0);
+                break;
+            case TILE_PROPERTY_BOOL:
+                tileset_set_property_bool(set, tile, name, text && (!strcmp(text, "true") || !strcmp(text, "1")));
+                break;
+            case TILE_PROPERTY_STRING:
+                tileset_set_property_string(set, tile, name, text);
+                break;
+        }
+
+        if(content) {
+            xmlFree(content);
+        }
+    }
+
+    if(value) {
+        sfree(value);
+    }
+    if(type_name) {
+        sfree(type_name);
+    }
+    sfree(name);
+}
+
+// Returns true if tile's value in the column isn't the default, and so needs to be written
+static bool property_has_value(const tile_property* prop, uint16 tile) {
+    switch(prop->type) {
+        case TILE_PROPERTY_INT:
+            return prop->ints[tile] != 0;
+        case TILE_PROPERTY_FLOAT:
+            return prop->floats[tile] != 0;
+        case TILE_PROPERTY_BOOL:
+            return prop->bools[tile];
+        case TILE_PROPERTY_STRING:
+            return prop->strings[tile] != NULL;
+    }
+
+    return false;
+}
+
+// Returns true if tile has a non-default value for any property
+static bool tileset_has_property_values(tileset set, uint16 tile) {
+    for(uint8 i = 0; i < set.property_count; ++i) {
+        if(property_has_value(&set.properties[i], tile)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Writes a <property> element for a column. If tile is NO_TILE, only the column's declaration is written.
+static void xml_write_tile_property(xmlTextWriter* writer, const tile_property* prop, uint16 tile) {
+    xmlTextWriterStartElement(writer, (xmlChar*)"property");
+    xml_property_write(writer, "name", prop->name);
+    xml_property_write(writer, "type", (char*)property_type_names[prop->type]);
+
+    if(tile != NO_TILE) {
+        char value[32];
+        switch(prop->type) {
+            case TILE_PROPERTY_INT:
+                snprintf(value, sizeof(value), "%d", prop->ints[tile]);
+                break;
+            case TILE_PROPERTY_FLOAT:
+                snprintf(value, sizeof(value), "%.9g", prop->floats[tile]);
+                break;
+            case TILE_PROPERTY_BOOL:
+                snprintf(value, sizeof(value), "%s", prop->bools[tile] ? "true" : "false");
+                break;
+            case TILE_PROPERTY_STRING:
+                value[0] = '\0';
+                break;
+        }
+        xml_property_write(writer, "value", prop->type == TILE_PROPERTY_STRING ? prop->strings[tile] : value);
+    }
+
+    xmlTextWriterEndElement(writer);
+}
+
+// Reads a <terrain> element and its <rule> children
+static void xml_read_terrain(xmlNodePtr node, tileset* set, const char* path) {
+    char* name = NULL;
+    if(!xml_property_read(node, "name", &name)) {
+        warn("Tileset %s has a terrain without a name", path);
+        return;
+    }
+
+    uint8 terrain = tileset_add_terrain(set, name);
+    sfree(name);
+    if(terrain == NO_TERRAIN) {
+        return;
+    }
+
+    xml_foreach(rule_node, node->children, "rule") {
+        uint8 mask = 0;
+        int16 x = -1;
+        int16 y = -1;
+        if(!xml_property_read(rule_node, "mask", &mask) || !xml_property_read(rule_node, "x", &x) || !xml_property_read(rule_node, "y", &y) || x < 0 || y < 0 || x >= set->width || y >= set->height) {
+            warn("Tileset %s has a terrain rule with a missing mask or out-of-bounds tile", path);
+            continue;
+        }
+
+        tileset_set_terrain_rule(set, terrain, mask, y * set->width + x);
+    }
+}
+
+/** @brief Reads a Tiled <wangset> into terrains
+ *
+ * Each color becomes a terrain, built from the tiles that only use that color.
+ * Corner sets have no edge information, so an edge counts as connected when both of its corners are.
+ */
+static void xml_read_tiled_wangset(xmlNodePtr node, tileset* set, const char* path) {
+    char* type = NULL;
+    xml_property_read(node, "type", &type);
+    bool corner = type && !strcmp(type, "corner");
+    if(type) {
+        sfree(type);
+    }
+
+    // Colors are numbered from 1 in wang ids
+    uint8 terrains[256];
+    uint16 color_count = 0;
+    xml_foreach(color_node, node->children, "wangcolor") {
+        if(color_count == 255) {
+            warn("Tileset %s has a wang set with too many colors", path);
+            break;
+        }
+
+        char* name = NULL;
+        uint8 terrain = NO_TERRAIN;
+        if(xml_property_read(color_node, "name", &name)) {
+            terrain = tileset_add_terrain(set, name);
+            sfree(name);
+        }
+        terrains[++color_count] = terrain;
+    }
+
+    xml_foreach(tile_node, node->children, "wangtile") {
+        uint16 tile = 0;
+        char* wang_id = NULL;
+        if(!xml_property_read(tile_node, "tileid", &tile) || !xml_property_read(tile_node, "wangid", &wang_id)) {
+            continue;
+        }
+
+        // Ids list the color of each side and corner, clockwise from the top
+        uint8 values[8] = {0};
+        uint8 count = 0;
+        const char* it = wang_id;
+        while(count < 8) {
+            char* end = NULL;
+            long value = strtol(it, &end, 10);
+            if(end == it) {
+                break;
+            }
+
+            values[count++] = value > 0 && value <= color_count ? value : 0;
+            if(*end != ',') {
+                break;
+            }
+            it = end + 1;
+        }
+        sfree(wang_id);
+        if(count != 8) {
+            warn("Tileset %s has a wang tile %d with an unsupported id format", path, tile);
+            continue;
+        }
+
+        // Transition tiles that mix several colors can't be expressed as a single terrain's rule
+        uint8 color = 0;
+        uint8 mask = 0;
+        bool mixed = false;
+        for(uint8 i = 0; i < 8; ++i) {
+            if(values[i] == 0) {
+                continue;
+            }
+            mixed |= color != 0 && values[i] != color;
+            color = values[i];
+            mask |= 1 << i;
+        }
+        if(color == 0 || mixed || terrains[color] == NO_TERRAIN) {
+            continue;
+        }
+
+        if(corner) {
+            uint8 ne = (mask >> 1) & 1, se = (mask >> 3) & 1, sw = (mask >> 5) & 1, nw = (mask >> 7) & 1;
+            mask |= (nw & ne) | ((ne & se) << 2) | ((se & sw) << 4) | ((sw & nw) << 6);
+        }
+
+        if(tile < set->width * set->height && set->terrains[terrains[color]].rules[mask] == NO_TILE) {
+            tileset_set_terrain_rule(set, terrains[color], mask, tile);
+        }
+    }
+}
 
 // Loads a tileset from path
 tileset load_tileset(const char* path) {
@@ -109,20 +352,41 @@ void xml_read_tileset(xmlNodePtr root, tileset* set, const char* path, bool part
             set->tile_box.dimensions.y /= (float)set->tex.height;
         }
 
+        xml_property_read(root, "padding", &set->padding);
+
         check_return(set->offset.x - set->tile_box.position.x + (set->tile_box.dimensions.x + set->tile_box.position.x) * set->width <= 1 || set->offset.y - set->tile_box.position.y + (set->tile_box.dimensions.y + set->tile_box.position.y) * set->height <= 1, "Dimensions of tileset %s are larger than the texture it uses", , path);
 
-        int16 x = -1;
-        int16 y = -1;
-        uint8 mask = -1;
+        // Columns are declared up front, so that they exist even when no tile has a value for them
+        xml_foreach(prop_node, root->children, "property") {
+            xml_read_tile_property(prop_node, set, NO_TILE, path);
+        }
+
         for(xmlNodePtr node = xml_match_name(root->children, "tile"); node; node = xml_match_name(node->next, "tile")) {
-            if(xml_property_read(node, "x", &x) && xml_property_read(node, "y", &y) && xml_property_read(node, "mask", &mask)) {
+            int16 x = -1;
+            int16 y = -1;
+            uint8 mask = 0;
+            if(!xml_property_read(node, "x", &x) || !xml_property_read(node, "y", &y) || x < 0 || y < 0 || x >= set->width || y >= set->height) {
+                warn("Tileset %s has a tile with missing or out-of-bounds coordinates", path);
+                continue;
+            }
+
+            if(xml_property_read(node, "mask", &mask)) {
                 tileset_set_mask(set, y * set->width + x, mask);
             }
+            xml_foreach(prop_node, node->children, "property") {
+                xml_read_tile_property(prop_node, set, y * set->width + x, path);
+            }
+        }
+
+        xml_foreach(terrain_node, root->children, "terrain") {
+            xml_read_terrain(terrain_node, set, path);
         }
     }
 }
 
 /** @brief Read a tileset's data from XML. This function is specifically for Tiled (.tsx) files
+ *
+ * Per-tile <properties> are read into the set's property columns, and <wangsets> into terrains.
  *
  * @param root The root XML node
  * @param set The tileset to populate
@@ -155,17 +419,33 @@ void xml_read_tiled_tileset(xmlNodePtr root, tileset* set, const char* path, mas
         }
     }
 
-    if (fn != NULL) {
-        xml_foreach(tile_node, root->children, "tile") {
-            uint16 tile;
-            if (xml_property_read(tile_node, "id", &tile)) {
-                uint8 mask = fn(tile_node);
-                if (mask != 0) {
-                    tileset_set_mask(set, tile, mask);
-                }
+    xml_foreach(tile_node, root->children, "tile") {
+        uint16 tile;
+        if (!xml_property_read(tile_node, "id", &tile)) {
+            continue;
+        }
+
+        if (fn != NULL) {
+            uint8 mask = fn(tile_node);
+            if (mask != 0) {
+                tileset_set_mask(set, tile, mask);
+            }
+        }
+
+        xmlNodePtr properties = xml_match_name(tile_node->children, "properties");
+        if (properties != NULL) {
+            xml_foreach(prop_node, properties->children, "property") {
+                xml_read_tile_property(prop_node, set, tile, path);
             }
         }
     }
+
+    xmlNodePtr wangsets = xml_match_name(root->children, "wangsets");
+    if (wangsets != NULL) {
+        xml_foreach(wangset_node, wangsets->children, "wangset") {
+            xml_read_tiled_wangset(wangset_node, set, path);
+        }
+    }
 }
 
 // Write a tileset's data to xml.
@@ -189,22 +469,53 @@ void xml_write_tileset(tileset set, xmlTextWriter* writer, const char* path, boo
         vec2 tile_dims = (vec2){ .x=(uint16)(set.tile_box.dimensions.x * set.tex.width), .y=(uint16)(set.tile_box.dimensions.y * set.tex.height) };
         xml_property_write(writer, "tile_dims", tile_dims);
 
+        if(set.padding > 0) {
+            xml_property_write(writer, "padding", set.padding);
+        }
+
         if(set.tex.asset_path) {
             char* t_path = get_relative_base(path, set.tex.asset_path);
             xml_property_write(writer, "file", set.tex.asset_path + strlen(t_path));
             sfree(t_path);
         }
 
-        if(set.tile_mask) {
-            for(uint16 i = 0; i < set.width * set.height; ++i) {
-                if(set.tile_mask[i]) {
-                    xmlTextWriterStartElement(writer, (xmlChar*)"tile");
-                    xml_property_write(writer, "x", i % set.width);
-                    xml_property_write(writer, "y", i / set.width);
-                    xml_property_write(writer, "mask", set.tile_mask[i]);
+        for(uint8 i = 0; i < set.property_count; ++i) {
+            xml_write_tile_property(writer, &set.properties[i], NO_TILE);
+        }
+
+        for(uint32 i = 0; i < set.width * set.height; ++i) {
+            uint8 mask = set.tile_mask ? set.tile_mask[i] : 0;
+            if(mask || tileset_has_property_values(set, i)) {
+                xmlTextWriterStartElement(writer, (xmlChar*)"tile");
+                xml_property_write(writer, "x", i % set.width);
+                xml_property_write(writer, "y", i / set.width);
+                if(mask) {
+                    xml_property_write(writer, "mask", mask);
+                }
+
+                for(uint8 j = 0; j < set.property_count; ++j) {
+                    if(property_has_value(&set.properties[j], i)) {
+                        xml_write_tile_property(writer, &set.properties[j], i);
+                    }
+                }
+                xmlTextWriterEndElement(writer);
+            }
+        }
+
+        for(uint8 i = 0; i < set.terrain_count; ++i) {
+            xmlTextWriterStartElement(writer, (xmlChar*)"terrain");
+            xml_property_write(writer, "name", set.terrains[i].name);
+            for(uint16 j = 0; j < 256; ++j) {
+                uint16 tile = set.terrains[i].rules[j];
+                if(tile != NO_TILE) {
+                    xmlTextWriterStartElement(writer, (xmlChar*)"rule");
+                    xml_property_write(writer, "mask", j);
+                    xml_property_write(writer, "x", tile % set.width);
+                    xml_property_write(writer, "y", tile / set.width);
                     xmlTextWriterEndElement(writer);
                 }
             }
+            xmlTextWriterEndElement(writer);
         }
     }
 
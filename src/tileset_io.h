@@ -16,6 +16,8 @@ void save_tileset(const char* path, tileset set);
 void xml_read_tileset(xmlNodePtr root, tileset* set, const char* path, bool partial);
 
 /** @brief Read a tileset's data from XML. This function is specifically for Tiled (.tsx) files
+ *
+ * Per-tile <properties> are read into the set's property columns, and <wangsets> into terrains.
  *
  * @param root The root XML node
  * @param set The tileset to populate
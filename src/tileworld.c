@@ -0,0 +1,573 @@
+// Log category, used to filter logs
+#define LOG_CATEGORY "Tiles"
+
+#include "tileworld.h"
+
+#include "core/check.h"
+#include "core/stringutil.h"
+#include "math/matrix.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "tilemap.priv.h"
+
+// How many calls to tileworld_set_camera worth of movement to prefetch ahead of the camera
+#define PREFETCH_FRAMES 30
+
+typedef enum chunk_state {
+    CHUNK_EMPTY = 0,
+    CHUNK_LOADING,
+    CHUNK_RESIDENT
+} chunk_state;
+
+typedef struct world_chunk {
+    int32 x;
+    int32 y;
+
+    chunk_state state;
+
+    // The map's version when it was last loaded or saved. Any edit bumps the version, including ones made through tileworld_get_chunk.
+    uint32 saved_version;
+    uint64 last_used;
+
+    tilemap map;
+} world_chunk;
+
+typedef enum chunk_job_type {
+    CHUNK_JOB_LOAD,
+    CHUNK_JOB_SAVE
+} chunk_job_type;
+
+// A unit of disk work for the background thread
+typedef struct chunk_job {
+    chunk_job_type type;
+    int32 x;
+    int32 y;
+
+    tile* data;
+
+    struct chunk_job* next;
+} chunk_job;
+
+typedef struct tileworld {
+    char* path;
+    tileset set;
+    uint16 chunk_size;
+    uint32 max_chunks;
+
+    // Open-addressed table of loading and loaded chunks, keyed by chunk coordinates
+    world_chunk* chunks;
+    uint32 capacity;
+    uint32 count;
+    uint32 last_slot;
+
+    aabb_2d camera;
+    bool has_camera;
+    uint64 frame;
+
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t load_ready;
+    chunk_job* queue_head;
+    chunk_job* queue_tail;
+    chunk_job* loaded;
+    bool quit;
+}* tileworld;
+
+// Divides a by b, rounding towards negative infinity
+static int32 floor_div(int32 a, int32 b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static uint32 chunk_hash(int32 x, int32 y) {
+    return ((uint32)x * 73856093u) ^ ((uint32)y * 19349663u);
+}
+
+// Returns the path to the file for chunk [x, y]. The result must be freed by the caller.
+static char* world_chunk_path(const tileworld world, int32 x, int32 y) {
+    size_t len = strlen(world->path) + 32;
+    char* path = mscalloc(len, char);
+    snprintf(path, len, "%s/%d_%d.chunk", world->path, x, y);
+
+    return path;
+}
+
+// Reads the tiles for chunk [x, y] from disk. Chunks that haven't been saved yet are empty.
+static tile* world_read_chunk(const tileworld world, int32 x, int32 y) {
+    uint32 area = world->chunk_size * world->chunk_size;
+    tile* data = mscalloc(area, tile);
+    for(uint32 i = 0; i < area; ++i) {
+        data[i] = (tile){ .id = NO_TILE, .mask = 0 };
+    }
+
+    char* path = world_chunk_path(world, x, y);
+    FILE* infile = fopen(path, "re");
+    if(infile) {
+        uint16 size = 0;
+        if(!check_warn(fread(&size, sizeof(size), 1, infile) == 1 && size == world->chunk_size, "Chunk file %s doesn't match the world's chunk size (%d), ignoring it", path, world->chunk_size)) {
+            check_warn(fread(data, sizeof(tile), area, infile) == area, "Unexpected end of file while reading chunk %s. Chunk may be incomplete.", path);
+        }
+        fclose(infile);
+    }
+    sfree(path);
+
+    return data;
+}
+
+// Writes the tiles for chunk [x, y] to disk
+static void world_write_chunk(const tileworld world, int32 x, int32 y, const tile* data) {
+    char* path = world_chunk_path(world, x, y);
+    FILE* outfile = fopen(path, "we");
+
+    if(!check_error(outfile != NULL, "Failed to save chunk: Can't open file at %s", path)) {
+        fwrite(&world->chunk_size, sizeof(world->chunk_size), 1, outfile);
+        fwrite(data, sizeof(tile), world->chunk_size * world->chunk_size, outfile);
+        fclose(outfile);
+    }
+    sfree(path);
+}
+
+// Background thread. Runs queued jobs in order, so a chunk's pending save always lands before it's loaded again.
+static void* world_worker(void* user) {
+    tileworld world = user;
+
+    pthread_mutex_lock(&world->lock);
+    while(true) {
+        while(!world->queue_head && !world->quit) {
+            pthread_cond_wait(&world->work_ready, &world->lock);
+        }
+
+        chunk_job* job = world->queue_head;
+        if(!job) {
+            break;
+        }
+        world->queue_head = job->next;
+        if(!world->queue_head) {
+            world->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&world->lock);
+
+        if(job->type == CHUNK_JOB_LOAD) {
+            job->data = world_read_chunk(world, job->x, job->y);
+        } else {
+            world_write_chunk(world, job->x, job->y, job->data);
+            sfree(job->data);
+        }
+
+        pthread_mutex_lock(&world->lock);
+        if(job->type == CHUNK_JOB_LOAD) {
+            job->next = world->loaded;
+            world->loaded = job;
+            pthread_cond_broadcast(&world->load_ready);
+        } else {
+            sfree(job);
+        }
+    }
+    pthread_mutex_unlock(&world->lock);
+
+    return NULL;
+}
+
+// Hands a job to the background thread
+static void world_queue_job(tileworld world, chunk_job_type type, int32 x, int32 y, tile* data) {
+    chunk_job* job = mscalloc(1, chunk_job);
+    job->type = type;
+    job->x = x;
+    job->y = y;
+    job->data = data;
+
+    pthread_mutex_lock(&world->lock);
+    if(world->queue_tail) {
+        world->queue_tail->next = job;
+    } else {
+        world->queue_head = job;
+    }
+    world->queue_tail = job;
+    pthread_cond_signal(&world->work_ready);
+    pthread_mutex_unlock(&world->lock);
+}
+
+// Queues a copy of chunk's tiles to be written to disk
+static void world_queue_save(tileworld world, world_chunk* chunk) {
+    uint32 area = world->chunk_size * world->chunk_size;
+    tile* data = mscalloc(area, tile);
+    memcpy(data, chunk->map->tile_data, area * sizeof(tile));
+
+    world_queue_job(world, CHUNK_JOB_SAVE, chunk->x, chunk->y, data);
+    chunk->saved_version = chunk->map->version;
+}
+
+// Returns true if chunk has been modified since it was loaded or last saved
+static bool world_chunk_modified(world_chunk* chunk) {
+    return chunk->map->version != chunk->saved_version;
+}
+
+// Returns the chunk entry for [x, y], or NULL if it isn't loading or loaded
+static world_chunk* world_find(tileworld world, int32 x, int32 y) {
+    world_chunk* cached = &world->chunks[world->last_slot];
+    if(cached->state != CHUNK_EMPTY && cached->x == x && cached->y == y) {
+        return cached;
+    }
+
+    uint32 mask = world->capacity - 1;
+    for(uint32 i = chunk_hash(x, y) & mask; world->chunks[i].state != CHUNK_EMPTY; i = (i + 1) & mask) {
+        if(world->chunks[i].x == x && world->chunks[i].y == y) {
+            world->last_slot = i;
+            return &world->chunks[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Inserts an entry for [x, y] without checking for an existing one
+static world_chunk* world_insert(tileworld world, int32 x, int32 y) {
+    // Keep the table at most 3/4 full, so that probes stay short
+    if((world->count + 1) * 4 > world->capacity * 3) {
+        world_chunk* old = world->chunks;
+        uint32 old_capacity = world->capacity;
+
+        world->capacity *= 2;
+        world->chunks = mscalloc(world->capacity, world_chunk);
+        world->count = 0;
+        world->last_slot = 0;
+        for(uint32 i = 0; i < old_capacity; ++i) {
+            if(old[i].state != CHUNK_EMPTY) {
+                *world_insert(world, old[i].x, old[i].y) = old[i];
+            }
+        }
+        sfree(old);
+    }
+
+    uint32 mask = world->capacity - 1;
+    uint32 i = chunk_hash(x, y) & mask;
+    while(world->chunks[i].state != CHUNK_EMPTY) {
+        i = (i + 1) & mask;
+    }
+
+    world->chunks[i] = (world_chunk){ .x = x, .y = y, .state = CHUNK_LOADING, .last_used = world->frame };
+    ++world->count;
+
+    return &world->chunks[i];
+}
+
+// Removes chunk from the table, shifting back any entries that probed past it
+static void world_remove(tileworld world, world_chunk* chunk) {
+    uint32 mask = world->capacity - 1;
+    uint32 i = chunk - world->chunks;
+    world->chunks[i].state = CHUNK_EMPTY;
+
+    for(uint32 j = (i + 1) & mask; world->chunks[j].state != CHUNK_EMPTY; j = (j + 1) & mask) {
+        uint32 home = chunk_hash(world->chunks[j].x, world->chunks[j].y) & mask;
+
+        // Entries can only move back if their home slot isn't cyclically between the hole and themselves
+        bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if(movable) {
+            world->chunks[i] = world->chunks[j];
+            world->chunks[j].state = CHUNK_EMPTY;
+            i = j;
+        }
+    }
+
+    --world->count;
+}
+
+// Starts loading chunk [x, y] if it isn't already loading or loaded
+static void world_request(tileworld world, int32 x, int32 y) {
+    world_chunk* chunk = world_find(world, x, y);
+    if(chunk) {
+        chunk->last_used = world->frame;
+        return;
+    }
+
+    world_insert(world, x, y);
+    world_queue_job(world, CHUNK_JOB_LOAD, x, y, NULL);
+}
+
+// Turns finished loads into drawable chunks. This has to run on the thread that owns the GL context.
+static void world_install_loaded(tileworld world) {
+    pthread_mutex_lock(&world->lock);
+    chunk_job* jobs = world->loaded;
+    world->loaded = NULL;
+    pthread_mutex_unlock(&world->lock);
+
+    while(jobs) {
+        chunk_job* next = jobs->next;
+
+        world_chunk* chunk = world_find(world, jobs->x, jobs->y);
+        if(chunk && chunk->state == CHUNK_LOADING) {
+            chunk->map = tilemap_new(world->chunk_size, world->chunk_size);
+            tilemap_set_tileset(chunk->map, world->set);
+            memcpy(chunk->map->tile_data, jobs->data, world->chunk_size * world->chunk_size * sizeof(tile));
+            chunk->map->mesh_dirty = true;
+            chunk->saved_version = chunk->map->version;
+            chunk->state = CHUNK_RESIDENT;
+        }
+
+        sfree(jobs->data);
+        sfree(jobs);
+        jobs = next;
+    }
+}
+
+// Returns the loaded chunk [x, y], blocking until it's been read from disk if necessary
+static world_chunk* world_acquire(tileworld world, int32 x, int32 y) {
+    world_request(world, x, y);
+
+    world_chunk* chunk = world_find(world, x, y);
+    while(chunk->state == CHUNK_LOADING) {
+        pthread_mutex_lock(&world->lock);
+        while(!world->loaded) {
+            pthread_cond_wait(&world->load_ready, &world->lock);
+        }
+        pthread_mutex_unlock(&world->lock);
+
+        world_install_loaded(world);
+        chunk = world_find(world, x, y);
+    }
+
+    return chunk;
+}
+
+// Unloads chunk, writing it back first if it was modified
+static void world_unload(tileworld world, world_chunk* chunk) {
+    if(world_chunk_modified(chunk)) {
+        world_queue_save(world, chunk);
+    }
+
+    tilemap_free(chunk->map, false);
+    world_remove(world, chunk);
+}
+
+// Unloads least recently used chunks outside of [x0, y0]-[x1, y1] until the world is back within its budget
+static void world_evict(tileworld world, int32 x0, int32 y0, int32 x1, int32 y1) {
+    while(world->count > world->max_chunks) {
+        world_chunk* oldest = NULL;
+        for(uint32 i = 0; i < world->capacity; ++i) {
+            world_chunk* chunk = &world->chunks[i];
+            if(chunk->state != CHUNK_RESIDENT || (chunk->x >= x0 && chunk->x <= x1 && chunk->y >= y0 && chunk->y <= y1)) {
+                continue;
+            }
+
+            if(!oldest || chunk->last_used < oldest->last_used) {
+                oldest = chunk;
+            }
+        }
+
+        if(!oldest) {
+            break;
+        }
+        world_unload(world, oldest);
+    }
+}
+
+// Creates a new world backed by the folder at path. Chunks are chunk_size tiles wide, and at most memory_budget bytes of tile data are kept loaded.
+tileworld tileworld_new(const char* path, tileset set, uint16 chunk_size, size_t memory_budget) {
+    check_return(path, "Trying to create a world without a path", NULL);
+    check_return(chunk_size != 0, "Trying to create a world with empty chunks", NULL);
+
+    if(mkdir(path, 0755) != 0 && errno != EEXIST) {
+        error("Can't create world folder at %s", path);
+        return NULL;
+    }
+
+    tileworld world = mscalloc(1, struct tileworld);
+    world->path = nstrdup(path);
+    world->set = set;
+    world->chunk_size = chunk_size;
+
+    world->max_chunks = memory_budget / (chunk_size * chunk_size * sizeof(tile));
+    if(check_warn(world->max_chunks > 0, "World memory budget of %zu bytes can't hold a single %dx%d chunk", memory_budget, chunk_size, chunk_size)) {
+        world->max_chunks = 1;
+    }
+
+    world->capacity = 16;
+    while(world->capacity < world->max_chunks * 2) {
+        world->capacity *= 2;
+    }
+    world->chunks = mscalloc(world->capacity, world_chunk);
+
+    pthread_mutex_init(&world->lock, NULL);
+    pthread_cond_init(&world->work_ready, NULL);
+    pthread_cond_init(&world->load_ready, NULL);
+    pthread_create(&world->worker, NULL, world_worker, world);
+
+    return world;
+}
+
+// Frees a world, writing back any modified chunks first. If deep is true, frees the tileset as well.
+void _tileworld_free(tileworld world, bool deep) {
+    tileworld_flush(world);
+
+    pthread_mutex_lock(&world->lock);
+    world->quit = true;
+    pthread_cond_signal(&world->work_ready);
+    pthread_mutex_unlock(&world->lock);
+    pthread_join(world->worker, NULL);
+
+    while(world->loaded) {
+        chunk_job* next = world->loaded->next;
+        sfree(world->loaded->data);
+        sfree(world->loaded);
+        world->loaded = next;
+    }
+
+    for(uint32 i = 0; i < world->capacity; ++i) {
+        if(world->chunks[i].state == CHUNK_RESIDENT) {
+            tilemap_free(world->chunks[i].map, false);
+        }
+    }
+
+    pthread_cond_destroy(&world->load_ready);
+    pthread_cond_destroy(&world->work_ready);
+    pthread_mutex_destroy(&world->lock);
+
+    if(deep) {
+        tileset_cleanup(&world->set);
+    }
+
+    sfree(world->chunks);
+    sfree(world->path);
+    sfree(world);
+}
+
+// Moves the camera to rect (in tiles). This loads the chunks it covers, prefetches chunks in the direction of travel, and evicts the least recently used chunks to stay within the memory budget.
+void tileworld_set_camera(tileworld world, aabb_2d rect) {
+    world_install_loaded(world);
+    ++world->frame;
+
+    vec2 motion = { .x = 0, .y = 0 };
+    if(world->has_camera) {
+        motion.x = rect.position.x - world->camera.position.x;
+        motion.y = rect.position.y - world->camera.position.y;
+    }
+    world->camera = rect;
+    world->has_camera = true;
+
+    int32 size = world->chunk_size;
+    int32 x0 = floor_div((int32)floorf(rect.position.x), size);
+    int32 y0 = floor_div((int32)floorf(rect.position.y), size);
+    int32 x1 = floor_div((int32)ceilf(rect.position.x + rect.dimensions.x) - 1, size);
+    int32 y1 = floor_div((int32)ceilf(rect.position.y + rect.dimensions.y) - 1, size);
+
+    // Visible chunks are queued first, so they're loaded before anything speculative
+    for(int32 i = y0; i <= y1; ++i) {
+        for(int32 j = x0; j <= x1; ++j) {
+            world_request(world, j, i);
+        }
+    }
+
+    // Prefetch the area the camera will sweep over if it keeps moving, as long as there's room in the budget
+    vec2 ahead = { .x = motion.x * PREFETCH_FRAMES, .y = motion.y * PREFETCH_FRAMES };
+    int32 px0 = floor_div((int32)floorf(rect.position.x + fminf(ahead.x, 0)), size);
+    int32 py0 = floor_div((int32)floorf(rect.position.y + fminf(ahead.y, 0)), size);
+    int32 px1 = floor_div((int32)ceilf(rect.position.x + rect.dimensions.x + fmaxf(ahead.x, 0)) - 1, size);
+    int32 py1 = floor_div((int32)ceilf(rect.position.y + rect.dimensions.y + fmaxf(ahead.y, 0)) - 1, size);
+    for(int32 i = py0; i <= py1 && world->count < world->max_chunks; ++i) {
+        for(int32 j = px0; j <= px1 && world->count < world->max_chunks; ++j) {
+            world_request(world, j, i);
+        }
+    }
+
+    world_evict(world, x0, y0, x1, y1);
+}
+
+// Sets the tile at [x, y]. If its chunk isn't loaded, this blocks until it is.
+void tileworld_set_tile(tileworld world, int32 x, int32 y, uint16 id) {
+    int32 cx = floor_div(x, world->chunk_size);
+    int32 cy = floor_div(y, world->chunk_size);
+    world_chunk* chunk = world_acquire(world, cx, cy);
+
+    uint16 lx = x - cx * world->chunk_size;
+    uint16 ly = y - cy * world->chunk_size;
+    if(chunk->map->tile_data[ly * world->chunk_size + lx].id != id) {
+        tilemap_set_tile(chunk->map, lx, ly, id);
+    }
+}
+
+// Sets the tile mask at [x, y]. If its chunk isn't loaded, this blocks until it is.
+void tileworld_set_tile_mask(tileworld world, int32 x, int32 y, uint8 mask) {
+    int32 cx = floor_div(x, world->chunk_size);
+    int32 cy = floor_div(y, world->chunk_size);
+    world_chunk* chunk = world_acquire(world, cx, cy);
+
+    uint16 lx = x - cx * world->chunk_size;
+    uint16 ly = y - cy * world->chunk_size;
+    if(chunk->map->tile_data[ly * world->chunk_size + lx].mask != mask) {
+        tilemap_set_tile_mask(chunk->map, lx, ly, mask);
+    }
+}
+
+// Returns the tile value at [x, y]. Returns NO_TILE if its chunk isn't loaded.
+tile tileworld_get_tile(tileworld world, int32 x, int32 y) {
+    int32 cx = floor_div(x, world->chunk_size);
+    int32 cy = floor_div(y, world->chunk_size);
+    world_chunk* chunk = world_find(world, cx, cy);
+    if(!chunk || chunk->state != CHUNK_RESIDENT) {
+        return (tile){ .id = NO_TILE, .mask = 0 };
+    }
+
+    return chunk->map->tile_data[(y - cy * world->chunk_size) * world->chunk_size + (x - cx * world->chunk_size)];
+}
+
+// Returns the loaded chunk containing [x, y], or NULL if it isn't loaded. The chunk is owned by the world, and may be evicted by the next call to tileworld_set_camera.
+// Edits made through it are written back like any others, but it must not be resized.
+tilemap tileworld_get_chunk(tileworld world, int32 x, int32 y) {
+    world_chunk* chunk = world_find(world, floor_div(x, world->chunk_size), floor_div(y, world->chunk_size));
+    if(!chunk || chunk->state != CHUNK_RESIDENT) {
+        return NULL;
+    }
+
+    return chunk->map;
+}
+
+// Returns the tileset for world
+tileset tileworld_get_tileset(tileworld world) {
+    return world->set;
+}
+
+// Returns the width and height of world's chunks
+uint16 tileworld_get_chunk_size(tileworld world) {
+    return world->chunk_size;
+}
+
+// Writes every modified chunk back to disk, without unloading them
+void tileworld_flush(tileworld world) {
+    for(uint32 i = 0; i < world->capacity; ++i) {
+        if(world->chunks[i].state == CHUNK_RESIDENT && world_chunk_modified(&world->chunks[i])) {
+            world_queue_save(world, &world->chunks[i]);
+        }
+    }
+}
+
+// Draws the loaded chunks that overlap the camera with the given shader and transformation matrices
+void tileworld_draw(tileworld world, shader s, mat4 model, mat4 view) {
+    world_install_loaded(world);
+
+    int32 size = world->chunk_size;
+    vec2 dims = tileset_get_tile_dims(world->set);
+    for(uint32 i = 0; i < world->capacity; ++i) {
+        world_chunk* chunk = &world->chunks[i];
+        if(chunk->state != CHUNK_RESIDENT) {
+            continue;
+        }
+
+        if(world->has_camera) {
+            float left = chunk->x * size;
+            float top = chunk->y * size;
+            if(left + size <= world->camera.position.x || left >= world->camera.position.x + world->camera.dimensions.x
+            || top + size <= world->camera.position.y || top >= world->camera.position.y + world->camera.dimensions.y) {
+                continue;
+            }
+        }
+
+        vec2 offset = { .x = chunk->x * size * dims.x, .y = chunk->y * size * dims.y };
+        tilemap_draw(chunk->map, s, mat4_mul(model, mat4_translate(mat4_ident, offset)), view);
+    }
+}
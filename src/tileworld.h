@@ -0,0 +1,45 @@
+#ifndef DF_TILES_TILEWORLD
+#define DF_TILES_TILEWORLD
+#include "tilemap.h"
+
+#include <stddef.h>
+
+// An unbounded map, split into square chunks that are paged in and out of a folder around a camera
+declarep(struct, tileworld)
+
+// Creates a new world backed by the folder at path. Chunks are chunk_size tiles wide, and at most memory_budget bytes of tile data are kept loaded.
+tileworld tileworld_new(const char* path, tileset set, uint16 chunk_size, size_t memory_budget);
+
+// Frees a world, writing back any modified chunks first. If deep is true, frees the tileset as well.
+#define tileworld_free(world, deep) { _tileworld_free(world, deep); world = NULL; }
+void _tileworld_free(tileworld world, bool deep);
+
+// Moves the camera to rect (in tiles). This loads the chunks it covers, prefetches chunks in the direction of travel, and evicts the least recently used chunks to stay within the memory budget.
+void tileworld_set_camera(tileworld world, aabb_2d rect);
+
+// Sets the tile at [x, y]. If its chunk isn't loaded, this blocks until it is.
+void tileworld_set_tile(tileworld world, int32 x, int32 y, uint16 id);
+
+// Sets the tile mask at [x, y]. If its chunk isn't loaded, this blocks until it is.
+void tileworld_set_tile_mask(tileworld world, int32 x, int32 y, uint8 mask);
+
+// Returns the tile value at [x, y]. Returns NO_TILE if its chunk isn't loaded.
+tile tileworld_get_tile(tileworld world, int32 x, int32 y);
+
+// Returns the loaded chunk containing [x, y], or NULL if it isn't loaded. The chunk is owned by the world, and may be evicted by the next call to tileworld_set_camera.
+// Edits made through it are written back like any others, but it must not be resized.
+tilemap tileworld_get_chunk(tileworld world, int32 x, int32 y);
+
+// Returns the tileset for world
+tileset tileworld_get_tileset(tileworld world);
+
+// Returns the width and height of world's chunks
+uint16 tileworld_get_chunk_size(tileworld world);
+
+// Writes every modified chunk back to disk, without unloading them
+void tileworld_flush(tileworld world);
+
+// Draws the loaded chunks that overlap the camera with the given shader and transformation matrices
+void tileworld_draw(tileworld world, shader s, mat4 model, mat4 view);
+
+#endif
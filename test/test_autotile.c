@@ -0,0 +1,132 @@
+#include "tilemap.h"
+#include "tilemap_autotile.h"
+#include "tilemap_delta.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ITERATIONS 20
+
+static int failures = 0;
+
+#define expect(cond, name) { if(!(cond)) { fprintf(stderr, "FAIL: %s (%s:%d)\n", name, __FILE__, __LINE__); ++failures; } }
+
+static uint8 grass;
+static uint8 water;
+
+// A blob set: one tile per reduced mask for each of two terrains
+static tileset blob_set() {
+    tileset set = tileset_empty;
+    tileset_resize(&set, 16, 8);
+    grass = tileset_add_terrain(&set, "grass");
+    water = tileset_add_terrain(&set, "water");
+
+    uint16 count = 0;
+    for(uint16 mask = 0; mask < 256; ++mask) {
+        if(tile_autotiler_reduce_mask(mask) == mask) {
+            tileset_set_terrain_rule(&set, grass, mask, count);
+            tileset_set_terrain_rule(&set, water, mask, 64 + count);
+            ++count;
+        }
+    }
+
+    return set;
+}
+
+// Paints the same terrain onto both maps
+static void paint_both(tile_autotiler a, tile_autotiler b, uint16 x, uint16 y, uint8 terrain) {
+    tile_autotiler_paint(a, x, y, terrain);
+    tile_autotiler_paint(b, x, y, terrain);
+}
+
+static void scatter(tile_autotiler a, tile_autotiler b, uint16 w, uint16 h, uint32 count) {
+    for(uint32 i = 0; i < count; ++i) {
+        paint_both(a, b, rand() % w, rand() % h, rand() % 2 ? water : grass);
+    }
+}
+
+// Runs budgeted updates until nothing is left, checking that none of them writes more tiles than its budget.
+// mid_edit is called once, part-way through, to check that edits made mid-drain are picked up.
+static void drain(tile_autotiler autotiler, tilemap map, uint32 budget, tile_autotiler other, uint16 w, uint16 h) {
+    uint32 left;
+    uint32 calls = 0;
+    bool within_budget = true;
+    do {
+        uint32 before = tilemap_get_version(map);
+        left = tile_autotiler_update(autotiler, budget);
+        within_budget &= tilemap_get_version(map) - before <= budget;
+
+        if(++calls == 3) {
+            scatter(autotiler, other, w, h, 50);
+        }
+    } while(left > 0);
+
+    expect(within_budget, "updates stay within max_cells");
+}
+
+static bool maps_equal(tilemap a, tilemap b) {
+    for(uint16 i = 0; i < tilemap_get_height(a); ++i) {
+        for(uint16 j = 0; j < tilemap_get_width(a); ++j) {
+            if(tilemap_get_tile(a, j, i).id != tilemap_get_tile(b, j, i).id) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    srand(1);
+
+    for(int i = 0; i < ITERATIONS; ++i) {
+        uint16 w = 50 + rand() % 150;
+        uint16 h = 50 + rand() % 150;
+
+        // The first map is updated incrementally, and the second is resolved in one go as a reference
+        tilemap map = tilemap_new(w, h);
+        tilemap reference = tilemap_new(w, h);
+        tilemap_set_tileset(map, blob_set());
+        tilemap_set_tileset(reference, blob_set());
+        tile_autotiler autotiler = tile_autotiler_new(map);
+        tile_autotiler expected = tile_autotiler_new(reference);
+
+        for(uint16 y = 0; y < h; ++y) {
+            for(uint16 x = 0; x < w; ++x) {
+                paint_both(autotiler, expected, x, y, grass);
+            }
+        }
+        tile_autotiler_update(autotiler, 0);
+        tile_autotiler_resolve_all(expected);
+        expect(maps_equal(map, reference), "unlimited update matches resolve_all");
+
+        // Small strokes fit in the journal, and leave cells queued across updates so that the queue gets compacted
+        scatter(autotiler, expected, w, h, 1000);
+        drain(autotiler, map, 1 + rand() % 200, expected, w, h);
+        tile_autotiler_resolve_all(expected);
+        expect(maps_equal(map, reference), "budgeted incremental updates match resolve_all");
+
+        // A stroke larger than the journal, or a resize, falls back to sweeping the whole map
+        scatter(autotiler, expected, w, h, 6000);
+        if(i % 3 == 0) {
+            w += 7;
+            h -= 3;
+            tilemap_resize(map, w, h);
+            tilemap_resize(reference, w, h);
+        }
+        drain(autotiler, map, 1 + rand() % 900, expected, w, h);
+        tile_autotiler_resolve_all(expected);
+        expect(maps_equal(map, reference), "budgeted sweep matches resolve_all");
+
+        tile_autotiler_free(expected);
+        tile_autotiler_free(autotiler);
+        tilemap_free(reference, true);
+        tilemap_free(map, true);
+    }
+
+    if(failures == 0) {
+        printf("All autotile tests passed\n");
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include "tilemap.h"
+#include "tilemap_delta.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAP_DIM 64
+#define JOURNAL_CAPACITY 256
+
+static int failures = 0;
+
+#define expect(cond, name) { if(!(cond)) { fprintf(stderr, "FAIL: %s (%s:%d)\n", name, __FILE__, __LINE__); ++failures; } }
+
+// Creates a map that can hold tile ids up to 15
+static tilemap map_new(uint16 w, uint16 h) {
+    tileset set = tileset_empty;
+    tileset_resize(&set, 4, 4);
+
+    tilemap map = tilemap_new(w, h);
+    tilemap_set_tileset(map, set);
+
+    return map;
+}
+
+// Returns true if a and b have the same dimensions and tiles
+static bool maps_equal(tilemap a, tilemap b) {
+    if(tilemap_get_width(a) != tilemap_get_width(b) || tilemap_get_height(a) != tilemap_get_height(b)) {
+        return false;
+    }
+
+    for(uint16 i = 0; i < tilemap_get_height(a); ++i) {
+        for(uint16 j = 0; j < tilemap_get_width(a); ++j) {
+            tile ta = tilemap_get_tile(a, j, i);
+            tile tb = tilemap_get_tile(b, j, i);
+            if(ta.id != tb.id || ta.mask != tb.mask) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void scribble(tilemap map, uint32 count) {
+    for(uint32 i = 0; i < count; ++i) {
+        tilemap_set_tile(map, rand() % MAP_DIM, rand() % MAP_DIM, rand() % 16);
+    }
+}
+
+// Encodes the changes to sender since version, and applies them to receiver
+static bool sync(tilemap sender, tilemap receiver, uint32* version) {
+    size_t length;
+    ubyte* data = tilemap_delta_encode(sender, *version, &length);
+    bool result = tilemap_delta_apply(receiver, data, length, version);
+    free(data);
+
+    return result;
+}
+
+int main(int argc, char** argv) {
+    srand(1);
+
+    tilemap sender = map_new(MAP_DIM, MAP_DIM);
+    tilemap receiver = map_new(1, 1);
+
+    // Changes made before the journal existed can only be sent as a keyframe, which also resizes the receiver
+    scribble(sender, 500);
+    tilemap_journal_enable(sender, JOURNAL_CAPACITY);
+    uint32 version = 0;
+    expect(sync(sender, receiver, &version), "keyframe applies");
+    expect(maps_equal(sender, receiver), "keyframe matches sender");
+    expect(version == tilemap_get_version(sender), "keyframe reports the sender's version");
+
+    // Small edits are sent incrementally
+    uint32 base = version;
+    scribble(sender, 20);
+    size_t length;
+    ubyte* incremental = tilemap_delta_encode(sender, base, &length);
+    expect(tilemap_delta_apply(receiver, incremental, length, &version), "incremental delta applies");
+    expect(maps_equal(sender, receiver), "incremental delta matches sender");
+    expect(version == tilemap_get_version(sender), "incremental delta reports the sender's version");
+
+    // Applying the same delta twice would be based on the wrong version
+    expect(!tilemap_delta_apply(receiver, incremental, length, &version), "duplicate delta is rejected");
+    expect(version == tilemap_get_version(sender), "rejected delta leaves the version alone");
+    free(incremental);
+
+    // More edits than the journal holds fall back to a keyframe
+    scribble(sender, JOURNAL_CAPACITY * 4);
+    ubyte* keyframe = tilemap_delta_encode(sender, version, &length);
+    size_t keyframe_length = length;
+    expect(tilemap_delta_apply(receiver, keyframe, keyframe_length, &version), "journal overflow falls back to a keyframe");
+    expect(maps_equal(sender, receiver), "fallback keyframe matches sender");
+    expect(version == tilemap_get_version(sender), "fallback keyframe reports the sender's version");
+
+    // A keyframe that arrives after newer changes would roll the map back, so it's rejected
+    scribble(sender, 10);
+    expect(sync(sender, receiver, &version), "delta after the keyframe applies");
+    expect(!tilemap_delta_apply(receiver, keyframe, keyframe_length, &version), "stale keyframe is rejected");
+    expect(maps_equal(sender, receiver), "stale keyframe leaves the map alone");
+    expect(version == tilemap_get_version(sender), "stale keyframe leaves the version alone");
+    free(keyframe);
+
+    // Deltas that arrive out of order are rejected, without touching the map
+    scribble(sender, 10);
+    ubyte* first = tilemap_delta_encode(sender, version, &length);
+    size_t first_length = length;
+    uint32 middle = tilemap_get_version(sender);
+    scribble(sender, 10);
+    ubyte* second = tilemap_delta_encode(sender, middle, &length);
+
+    tilemap before = map_new(MAP_DIM, MAP_DIM);
+    for(uint16 i = 0; i < MAP_DIM; ++i) {
+        for(uint16 j = 0; j < MAP_DIM; ++j) {
+            tilemap_set_tile(before, j, i, tilemap_get_tile(receiver, j, i).id);
+        }
+    }
+    expect(!tilemap_delta_apply(receiver, second, length, &version), "out-of-order delta is rejected");
+    expect(maps_equal(before, receiver), "rejected delta leaves the map alone");
+    expect(tilemap_delta_apply(receiver, first, first_length, &version), "first delta applies");
+    expect(tilemap_delta_apply(receiver, second, length, &version), "second delta applies after the first");
+    expect(maps_equal(sender, receiver), "in-order deltas match sender");
+
+    free(first);
+    free(second);
+    tilemap_free(before, true);
+    tilemap_free(receiver, true);
+    tilemap_free(sender, true);
+
+    if(failures == 0) {
+        printf("All delta tests passed\n");
+    }
+
+    return failures == 0 ? 0 : 1;
+}
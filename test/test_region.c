@@ -0,0 +1,188 @@
+#include "tilemap.h"
+#include "tilemap_region.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ITERATIONS 200
+#define MAX_DIM 64
+
+static int failures = 0;
+
+#define expect(cond, name) { if(!(cond)) { fprintf(stderr, "FAIL: %s (%s:%d)\n", name, __FILE__, __LINE__); ++failures; } }
+
+// Tiles 1 and 3 share mask bit 1, so that matching by mask joins regions that matching by id keeps apart
+static tilemap map_new(uint16 w, uint16 h) {
+    tileset set = tileset_empty;
+    tileset_resize(&set, 4, 4);
+    tileset_set_mask(&set, 1, 1);
+    tileset_set_mask(&set, 3, 1);
+
+    tilemap map = tilemap_new(w, h);
+    tilemap_set_tileset(map, set);
+
+    return map;
+}
+
+// Fills map with a few tile ids, mostly copied from a neighbour so that regions are larger than single tiles
+static void scribble(tilemap map) {
+    uint16 w = tilemap_get_width(map);
+    uint16 h = tilemap_get_height(map);
+    for(uint16 i = 0; i < h; ++i) {
+        for(uint16 j = 0; j < w; ++j) {
+            uint16 id = rand() % 4;
+            if(rand() % 3 != 0 && j > 0) {
+                id = tilemap_get_tile(map, j - 1, i).id;
+            } else if(rand() % 2 == 0 && i > 0) {
+                id = tilemap_get_tile(map, j, i - 1).id;
+            }
+            tilemap_set_tile(map, j, i, id);
+        }
+    }
+}
+
+static uint16 key_of(tile t, tile_match match) {
+    return match == TILE_MATCH_ID ? t.id : (t.mask & 1);
+}
+
+// Labels the regions of tiles with a plain breadth-first search, numbering them in order of their first tile.
+// Returns the number of regions.
+static uint32 naive_label(const tile* tiles, uint32 w, uint32 h, tile_match match, uint32* labels) {
+    uint32* queue = malloc(w * h * sizeof(uint32));
+    for(uint32 i = 0; i < w * h; ++i) {
+        labels[i] = UINT32_MAX;
+    }
+
+    uint32 count = 0;
+    for(uint32 start = 0; start < w * h; ++start) {
+        if(labels[start] != UINT32_MAX) {
+            continue;
+        }
+
+        uint16 key = key_of(tiles[start], match);
+        uint32 head = 0;
+        uint32 tail = 0;
+        queue[tail++] = start;
+        labels[start] = count;
+        while(head < tail) {
+            uint32 index = queue[head++];
+            uint32 x = index % w;
+            uint32 y = index / w;
+            uint32 neighbours[4] = { x > 0 ? index - 1 : UINT32_MAX, x + 1 < w ? index + 1 : UINT32_MAX, y > 0 ? index - w : UINT32_MAX, y + 1 < h ? index + w : UINT32_MAX };
+            for(int i = 0; i < 4; ++i) {
+                uint32 n = neighbours[i];
+                if(n != UINT32_MAX && labels[n] == UINT32_MAX && key_of(tiles[n], match) == key) {
+                    labels[n] = count;
+                    queue[tail++] = n;
+                }
+            }
+        }
+        ++count;
+    }
+
+    free(queue);
+    return count;
+}
+
+static void test_fill(tilemap map, tile_match match) {
+    uint16 w = tilemap_get_width(map);
+    uint16 h = tilemap_get_height(map);
+    tile* before = malloc(w * h * sizeof(tile));
+    for(uint32 i = 0; i < (uint32)w * h; ++i) {
+        before[i] = tilemap_get_tile(map, i % w, i / w);
+    }
+
+    uint32* labels = malloc(w * h * sizeof(uint32));
+    naive_label(before, w, h, match, labels);
+
+    uint16 x = rand() % w;
+    uint16 y = rand() % h;
+    uint16 id = rand() % 4;
+    uint32 region = labels[y * w + x];
+    uint32 filled = tilemap_flood_fill(map, x, y, id, match, 1);
+
+    uint32 expected = 0;
+    bool matches = true;
+    for(uint32 i = 0; i < (uint32)w * h; ++i) {
+        tile t = tilemap_get_tile(map, i % w, i / w);
+        if(labels[i] == region) {
+            ++expected;
+            matches &= t.id == id;
+        } else {
+            matches &= t.id == before[i].id && t.mask == before[i].mask;
+        }
+    }
+    expect(matches, match == TILE_MATCH_ID ? "fill by id changes exactly the start's region" : "fill by mask changes exactly the start's region");
+    expect(filled == expected, "fill reports the size of the region");
+
+    free(labels);
+    free(before);
+}
+
+static void test_label(tilemap map, tile_match match) {
+    uint16 w = tilemap_get_width(map);
+    uint16 h = tilemap_get_height(map);
+    tile* tiles = malloc(w * h * sizeof(tile));
+    for(uint32 i = 0; i < (uint32)w * h; ++i) {
+        tiles[i] = tilemap_get_tile(map, i % w, i / w);
+    }
+
+    uint32* expected = malloc(w * h * sizeof(uint32));
+    uint32 count = naive_label(tiles, w, h, match, expected);
+    tile_labels labels = tilemap_label_regions(map, match, 1);
+
+    expect(labels.region_count == count, "labelling finds every region");
+    expect(labels.region_count != count || !memcmp(labels.labels, expected, w * h * sizeof(uint32)), "labels match a breadth-first search");
+
+    // Check each region's statistics against the tiles it was given
+    bool stats = labels.region_count == count;
+    for(uint32 r = 0; r < count && stats; ++r) {
+        uint32 size = 0;
+        uint16 min_x = UINT16_MAX, min_y = UINT16_MAX, max_x = 0, max_y = 0;
+        int64 first = -1;
+        for(uint32 i = 0; i < (uint32)w * h; ++i) {
+            if(expected[i] != r) {
+                continue;
+            }
+            uint16 x = i % w;
+            uint16 y = i / w;
+            first = first < 0 ? i : first;
+            min_x = x < min_x ? x : min_x;
+            max_x = x > max_x ? x : max_x;
+            min_y = y < min_y ? y : min_y;
+            max_y = y > max_y ? y : max_y;
+            ++size;
+        }
+
+        tile_region* region = &labels.regions[r];
+        stats = region->size == size && region->min_x == min_x && region->max_x == max_x && region->min_y == min_y && region->max_y == max_y
+             && region->sample.id == tiles[first].id;
+    }
+    expect(stats, "region statistics match their tiles");
+
+    tile_labels_cleanup(&labels);
+    free(expected);
+    free(tiles);
+}
+
+int main(int argc, char** argv) {
+    srand(1);
+
+    for(int i = 0; i < ITERATIONS; ++i) {
+        tilemap map = map_new(1 + rand() % MAX_DIM, 1 + rand() % MAX_DIM);
+        scribble(map);
+
+        tile_match match = i % 2 ? TILE_MATCH_MASK : TILE_MATCH_ID;
+        test_label(map, match);
+        test_fill(map, match);
+
+        tilemap_free(map, true);
+    }
+
+    if(failures == 0) {
+        printf("All region tests passed\n");
+    }
+
+    return failures == 0 ? 0 : 1;
+}